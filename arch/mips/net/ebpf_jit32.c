@@ -0,0 +1,1503 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Just-In-Time compiler for eBPF filters on 32-bit MIPS
+ *
+ * Based on the 64-bit eBPF JIT in ebpf_jit.c:
+ *
+ * Copyright (c) 2017 Cavium, Inc.
+ *
+ * Copyright (c) 2014 Imagination Technologies Ltd.
+ * Author: Markos Chandras <markos.chandras@imgtec.com>
+ */
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/filter.h>
+#include <linux/bpf.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <asm/byteorder.h>
+#include <asm/cacheflush.h>
+#include <asm/isa-rev.h>
+#include <asm/uasm.h>
+
+/* Registers used by JIT */
+#define MIPS_R_ZERO	0
+#define MIPS_R_AT	1
+#define MIPS_R_V0	2	/* BPF_R0 */
+#define MIPS_R_V1	3
+#define MIPS_R_A0	4	/* BPF_R1 */
+#define MIPS_R_A1	5
+#define MIPS_R_A2	6	/* BPF_R2 */
+#define MIPS_R_A3	7
+#define MIPS_R_T0	8	/* BPF_R3 */
+#define MIPS_R_T1	9
+#define MIPS_R_T2	10	/* BPF_R4 */
+#define MIPS_R_T3	11
+#define MIPS_R_T4	12	/* BPF_R5 */
+#define MIPS_R_T5	13
+#define MIPS_R_T6	14
+#define MIPS_R_T7	15
+#define MIPS_R_S0	16	/* BPF_R6 */
+#define MIPS_R_S1	17
+#define MIPS_R_S2	18	/* BPF_R7 */
+#define MIPS_R_S3	19
+#define MIPS_R_S4	20	/* BPF_R8 */
+#define MIPS_R_S5	21
+#define MIPS_R_S6	22	/* BPF_R9 */
+#define MIPS_R_S7	23
+#define MIPS_R_T8	24	/* BPF_AX */
+#define MIPS_R_T9	25
+#define MIPS_R_SP	29
+#define MIPS_R_FP	30	/* BPF_R10 */
+#define MIPS_R_RA	31
+
+/* Callee saved registers, saved in the prologue when used */
+#define JIT_CALLEE_SAVED	(GENMASK(MIPS_R_S7, MIPS_R_S0) |	\
+				 BIT(MIPS_R_FP) | BIT(MIPS_R_RA))
+
+/* eBPF flags */
+#define EBPF_SEEN_TC	BIT(0)
+#define EBPF_SEEN_DIV64	BIT(1)
+
+/*
+ * Index of the low and high word of a 64-bit value held in a register
+ * pair. Pairs are in memory order, like the o32 ABI passes 64-bit
+ * arguments and results in $a0/$a1, $a2/$a3 and $v0/$v1.
+ */
+#ifdef __BIG_ENDIAN
+#define LO	1
+#define HI	0
+#else
+#define LO	0
+#define HI	1
+#endif
+
+/*
+ * The o32 argument area the caller reserves for the callee: the four
+ * argument register slots, then the third to fifth 64-bit argument.
+ */
+#define JIT_ARGS_SIZE	40
+
+/*
+ * high bit of offsets indicates if long branch conversion done at
+ * this insn.
+ */
+#define OFFSETS_B_CONV	BIT(31)
+
+/**
+ * struct jit_ctx - JIT context
+ * @skf:		The sk_filter
+ * @stack_size:		Size of the stack frame
+ * @fp_off:		Offset of BPF_REG_10 from $sp
+ * @tcc_off:		Offset of the tail call count from $sp
+ * @div64_off:		Offset of the register save area for DIV64/MOD64
+ * @idx:		Instruction index
+ * @flags:		JIT flags
+ * @saved_regs:		Mask of the callee saved registers in use
+ * @offsets:		Instruction offsets
+ * @target:		Memory location for the compiled filter
+ */
+struct jit_ctx {
+	const struct bpf_prog *skf;
+	int stack_size;
+	int fp_off;
+	int tcc_off;
+	int div64_off;
+	u32 idx;
+	u32 flags;
+	u32 saved_regs;
+	u32 *offsets;
+	u32 *target;
+	unsigned int long_b_conversion:1;
+	unsigned int gen_b_offsets:1;
+};
+
+/* Simply emit the instruction if the JIT memory space has been allocated */
+#define emit_instr(ctx, func, ...)				\
+do {								\
+	if ((ctx)->target != NULL) {				\
+		u32 *p = &(ctx)->target[ctx->idx];		\
+		uasm_i_##func(&p, ##__VA_ARGS__);		\
+	}							\
+	(ctx)->idx++;						\
+} while (0)
+
+static unsigned int j_target(struct jit_ctx *ctx, int target_idx)
+{
+	unsigned long target_va, base_va;
+	unsigned int r;
+
+	if (!ctx->target)
+		return 0;
+
+	base_va = (unsigned long)ctx->target;
+	target_va = base_va + (ctx->offsets[target_idx] & ~OFFSETS_B_CONV);
+
+	if ((base_va & ~0x0ffffffful) != (target_va & ~0x0ffffffful))
+		return (unsigned int)-1;
+	r = target_va & 0x0ffffffful;
+	return r;
+}
+
+/* Compute the immediate value for PC-relative branches. */
+static u32 b_imm(unsigned int tgt, struct jit_ctx *ctx)
+{
+	if (!ctx->gen_b_offsets)
+		return 0;
+
+	/*
+	 * We want a pc-relative branch.  tgt is the instruction offset
+	 * we want to jump to.
+
+	 * Branch on MIPS:
+	 * I: target_offset <- sign_extend(offset)
+	 * I+1: PC += target_offset (delay slot)
+	 *
+	 * ctx->idx currently points to the branch instruction
+	 * but the offset is added to the delay slot so we need
+	 * to subtract 4.
+	 */
+	return (ctx->offsets[tgt] & ~OFFSETS_B_CONV) -
+		(ctx->idx * 4) - 4;
+}
+
+static bool is_bad_offset(int b_off)
+{
+	return b_off > 0x1ffff || b_off < -0x20000;
+}
+
+/*
+ * Every eBPF register lives in a pair of o32 registers. BPF_REG_1 to
+ * BPF_REG_5 line up with the arguments of a helper call, the first two
+ * in $a0-$a3 and the others stored to the stack, and BPF_REG_0 with
+ * its result. BPF_REG_10 is a frame pointer, its high word is always
+ * zero. $at, $t6 and $t7 are left for temporaries.
+ */
+static const u8 bpf2mips32[][2] = {
+	[BPF_REG_0] = {MIPS_R_V0, MIPS_R_V1},
+	[BPF_REG_1] = {MIPS_R_A0, MIPS_R_A1},
+	[BPF_REG_2] = {MIPS_R_A2, MIPS_R_A3},
+	[BPF_REG_3] = {MIPS_R_T0, MIPS_R_T1},
+	[BPF_REG_4] = {MIPS_R_T2, MIPS_R_T3},
+	[BPF_REG_5] = {MIPS_R_T4, MIPS_R_T5},
+	[BPF_REG_6] = {MIPS_R_S0, MIPS_R_S1},
+	[BPF_REG_7] = {MIPS_R_S2, MIPS_R_S3},
+	[BPF_REG_8] = {MIPS_R_S4, MIPS_R_S5},
+	[BPF_REG_9] = {MIPS_R_S6, MIPS_R_S7},
+	[BPF_REG_10] = {[LO] = MIPS_R_FP, [HI] = MIPS_R_ZERO},
+	[BPF_REG_AX] = {MIPS_R_T8, MIPS_R_T9},
+};
+
+/* Temporary pair for immediates and the DIV64/MOD64 divisor */
+static const u8 tmp_pair[2] = {MIPS_R_T6, MIPS_R_T7};
+
+static const u8 *ebpf_to_mips_reg(struct jit_ctx *ctx, int ebpf_reg)
+{
+	const u8 *r = bpf2mips32[ebpf_reg];
+
+	ctx->saved_regs |= (BIT(r[0]) | BIT(r[1])) & JIT_CALLEE_SAVED;
+	return r;
+}
+
+/*
+ * eBPF stack frame will be something like:
+ *
+ *  Entry $sp ------>   +--------------------------------+
+ *                      |   $ra  (optional)              |
+ *                      +--------------------------------+
+ *                      |   $fp  (optional)              |
+ *                      +--------------------------------+
+ *                      |   $s7 ... $s0  (optional)      |
+ *                      +--------------------------------+
+ *                      |   tail call count  (optional)  |
+ * $sp + fp_off ---->   +--------------------------------+ <--BPF_REG_10
+ *                      |   BPF_REG_10 relative storage  |
+ *                      |    MAX_BPF_STACK (optional)    |
+ *                      |      .                         |
+ *                      |      .                         |
+ *                      |      .                         |
+ * $sp + div64_off ->   +--------------------------------+
+ *                      |   caller saved registers       |
+ *                      |   for DIV64/MOD64 (optional)   |
+ *                      +--------------------------------+
+ *                      |   outgoing o32 arguments       |
+ *                      |   (if $ra saved)               |
+ *     $sp -------->    +--------------------------------+
+ *
+ * If BPF_REG_10 is never referenced, then the MAX_BPF_STACK sized
+ * area is not allocated.
+ */
+
+/* Registers a DIV64/MOD64 helper call may clobber */
+static const u8 div64_saved[] = {
+	MIPS_R_V0, MIPS_R_V1, MIPS_R_A0, MIPS_R_A1, MIPS_R_A2, MIPS_R_A3,
+	MIPS_R_T0, MIPS_R_T1, MIPS_R_T2, MIPS_R_T3, MIPS_R_T4, MIPS_R_T5,
+	MIPS_R_T8, MIPS_R_T9,
+};
+
+static int gen_int_prologue(struct jit_ctx *ctx)
+{
+	const u8 *r1 = bpf2mips32[BPF_REG_1];
+	int stack_adjust = 0;
+	int store_offset;
+	int r;
+
+	if (ctx->saved_regs & BIT(MIPS_R_RA))
+		stack_adjust += JIT_ARGS_SIZE;
+	ctx->div64_off = stack_adjust;
+	if (ctx->flags & EBPF_SEEN_DIV64)
+		stack_adjust += sizeof(div64_saved) * sizeof(u32);
+
+	BUILD_BUG_ON(MAX_BPF_STACK & 7);
+	if (ctx->saved_regs & BIT(MIPS_R_FP))
+		stack_adjust += MAX_BPF_STACK;
+	ctx->fp_off = stack_adjust;
+	ctx->tcc_off = stack_adjust;
+	if (ctx->flags & EBPF_SEEN_TC)
+		stack_adjust += sizeof(u32);
+
+	stack_adjust += hweight32(ctx->saved_regs) * sizeof(u32);
+	stack_adjust = ALIGN(stack_adjust, 8);
+
+	ctx->stack_size = stack_adjust;
+
+	/*
+	 * First instruction initializes the tail call count (TCC).
+	 * On tail call we skip this instruction, and the TCC is
+	 * passed in $v1 from the caller.
+	 */
+	emit_instr(ctx, addiu, MIPS_R_V1, MIPS_R_ZERO, MAX_TAIL_CALL_CNT);
+	if (stack_adjust)
+		emit_instr(ctx, addiu, MIPS_R_SP, MIPS_R_SP, -stack_adjust);
+
+	store_offset = stack_adjust;
+	for (r = MIPS_R_RA; r >= MIPS_R_S0; r--) {
+		if (!(ctx->saved_regs & BIT(r)))
+			continue;
+		store_offset -= sizeof(u32);
+		emit_instr(ctx, sw, r, store_offset, MIPS_R_SP);
+	}
+
+	if (ctx->saved_regs & BIT(MIPS_R_FP))
+		emit_instr(ctx, addiu, MIPS_R_FP, MIPS_R_SP, ctx->fp_off);
+	if (ctx->flags & EBPF_SEEN_TC)
+		emit_instr(ctx, sw, MIPS_R_V1, ctx->tcc_off, MIPS_R_SP);
+
+	/*
+	 * The context is a 32-bit pointer in $a0, zero extend it into
+	 * BPF_REG_1. A tail call passes it in $a0 as well.
+	 */
+	if (r1[LO] != MIPS_R_A0)
+		emit_instr(ctx, addu, r1[LO], MIPS_R_A0, MIPS_R_ZERO);
+	emit_instr(ctx, addu, r1[HI], MIPS_R_ZERO, MIPS_R_ZERO);
+
+	return 0;
+}
+
+static int build_int_epilogue(struct jit_ctx *ctx, int dest_reg)
+{
+	const u8 *r0 = bpf2mips32[BPF_REG_0];
+	int stack_adjust = ctx->stack_size;
+	int store_offset = stack_adjust;
+	int r;
+
+	/* The native return value is the low word of BPF_REG_0. */
+	if (dest_reg == MIPS_R_RA && r0[LO] != MIPS_R_V0)
+		emit_instr(ctx, addu, MIPS_R_V0, r0[LO], MIPS_R_ZERO);
+
+	for (r = MIPS_R_RA; r >= MIPS_R_S0; r--) {
+		if (!(ctx->saved_regs & BIT(r)))
+			continue;
+		store_offset -= sizeof(u32);
+		emit_instr(ctx, lw, r, store_offset, MIPS_R_SP);
+	}
+	emit_instr(ctx, jr, dest_reg);
+
+	if (stack_adjust)
+		emit_instr(ctx, addiu, MIPS_R_SP, MIPS_R_SP, stack_adjust);
+	else
+		emit_instr(ctx, nop);
+
+	return 0;
+}
+
+static void gen_imm_to_reg(struct jit_ctx *ctx, int reg, s32 imm)
+{
+	if (imm >= S16_MIN && imm <= S16_MAX) {
+		emit_instr(ctx, addiu, reg, MIPS_R_ZERO, imm);
+	} else {
+		int lower = (s16)(imm & 0xffff);
+		int upper = imm - lower;
+
+		emit_instr(ctx, lui, reg, upper >> 16);
+		if (lower)
+			emit_instr(ctx, addiu, reg, reg, lower);
+	}
+}
+
+/*
+ * Load the sign extended immediate into tmp_pair and fill in @pair
+ * with the registers holding it, $zero for zero words.
+ */
+static void gen_imm_pair(struct jit_ctx *ctx, s32 imm, u8 *pair)
+{
+	pair[LO] = MIPS_R_ZERO;
+	pair[HI] = MIPS_R_ZERO;
+	if (imm) {
+		gen_imm_to_reg(ctx, tmp_pair[LO], imm);
+		pair[LO] = tmp_pair[LO];
+	}
+	if (imm < 0) {
+		emit_instr(ctx, addiu, tmp_pair[HI], MIPS_R_ZERO, -1);
+		pair[HI] = tmp_pair[HI];
+	}
+}
+
+/*
+ * 32-bit operations zero the high word, unless the verifier inserts
+ * explicit zero extensions where they are needed.
+ */
+static void emit_zext_32(struct jit_ctx *ctx, const u8 *dst)
+{
+	if (!ctx->skf->aux->verifier_zext)
+		emit_instr(ctx, addu, dst[HI], MIPS_R_ZERO, MIPS_R_ZERO);
+}
+
+static int emit_alu32_reg(struct jit_ctx *ctx, int bpf_op, int dst, int src)
+{
+	switch (bpf_op) {
+	case BPF_MOV:
+		if (dst != src)
+			emit_instr(ctx, addu, dst, src, MIPS_R_ZERO);
+		break;
+	case BPF_ADD:
+		emit_instr(ctx, addu, dst, dst, src);
+		break;
+	case BPF_SUB:
+		emit_instr(ctx, subu, dst, dst, src);
+		break;
+	case BPF_XOR:
+		emit_instr(ctx, xor, dst, dst, src);
+		break;
+	case BPF_OR:
+		emit_instr(ctx, or, dst, dst, src);
+		break;
+	case BPF_AND:
+		emit_instr(ctx, and, dst, dst, src);
+		break;
+	case BPF_MUL:
+		emit_instr(ctx, mul, dst, dst, src);
+		break;
+	case BPF_DIV:
+	case BPF_MOD:
+		if (MIPS_ISA_REV >= 6) {
+			if (bpf_op == BPF_DIV)
+				emit_instr(ctx, divu_r6, dst, dst, src);
+			else
+				emit_instr(ctx, modu, dst, dst, src);
+			break;
+		}
+		emit_instr(ctx, divu, dst, src);
+		if (bpf_op == BPF_DIV)
+			emit_instr(ctx, mflo, dst);
+		else
+			emit_instr(ctx, mfhi, dst);
+		break;
+	case BPF_LSH:
+		emit_instr(ctx, sllv, dst, dst, src);
+		break;
+	case BPF_RSH:
+		emit_instr(ctx, srlv, dst, dst, src);
+		break;
+	case BPF_ARSH:
+		emit_instr(ctx, srav, dst, dst, src);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int emit_alu32_imm(struct jit_ctx *ctx, int bpf_op, int dst, s32 imm)
+{
+	switch (bpf_op) {
+	case BPF_MOV:
+		gen_imm_to_reg(ctx, dst, imm);
+		return 0;
+	case BPF_ADD:
+		if (imm >= S16_MIN && imm <= S16_MAX) {
+			emit_instr(ctx, addiu, dst, dst, imm);
+			return 0;
+		}
+		break;
+	case BPF_SUB:
+		if (imm >= -S16_MAX && imm <= -S16_MIN) {
+			emit_instr(ctx, addiu, dst, dst, -imm);
+			return 0;
+		}
+		break;
+	case BPF_AND:
+	case BPF_OR:
+	case BPF_XOR:
+		if (imm < 0 || imm > 0xffff)
+			break;
+		if (bpf_op == BPF_AND)
+			emit_instr(ctx, andi, dst, dst, imm);
+		else if (bpf_op == BPF_OR)
+			emit_instr(ctx, ori, dst, dst, imm);
+		else
+			emit_instr(ctx, xori, dst, dst, imm);
+		return 0;
+	case BPF_LSH:
+		emit_instr(ctx, sll, dst, dst, imm & 0x1f);
+		return 0;
+	case BPF_RSH:
+		emit_instr(ctx, srl, dst, dst, imm & 0x1f);
+		return 0;
+	case BPF_ARSH:
+		emit_instr(ctx, sra, dst, dst, imm & 0x1f);
+		return 0;
+	case BPF_DIV:
+	case BPF_MOD:
+		if (imm == 0)
+			return -EINVAL;
+		if (imm == 1) {
+			/* div by 1 is a nop, mod by 1 is zero */
+			if (bpf_op == BPF_MOD)
+				emit_instr(ctx, addu, dst, MIPS_R_ZERO, MIPS_R_ZERO);
+			return 0;
+		}
+		break;
+	}
+	gen_imm_to_reg(ctx, MIPS_R_AT, imm);
+	return emit_alu32_reg(ctx, bpf_op, dst, MIPS_R_AT);
+}
+
+/*
+ * 64-bit operations on register pairs. @src may be @dst, tmp_pair or
+ * have $zero words, only $at is used as a temporary.
+ */
+static int emit_alu64_reg(struct jit_ctx *ctx, int bpf_op,
+			  const u8 *dst, const u8 *src)
+{
+	int dl = dst[LO], dh = dst[HI], sl = src[LO], sh = src[HI];
+
+	switch (bpf_op) {
+	case BPF_MOV:
+		if (dl != sl)
+			emit_instr(ctx, addu, dl, sl, MIPS_R_ZERO);
+		if (dh != sh)
+			emit_instr(ctx, addu, dh, sh, MIPS_R_ZERO);
+		break;
+	case BPF_ADD:
+		if (dl == sl) {
+			/* The carry out of the low word is its top bit */
+			emit_instr(ctx, srl, MIPS_R_AT, dl, 31);
+			emit_instr(ctx, addu, dl, dl, dl);
+		} else {
+			emit_instr(ctx, addu, dl, dl, sl);
+			emit_instr(ctx, sltu, MIPS_R_AT, dl, sl);
+		}
+		if (sh != MIPS_R_ZERO)
+			emit_instr(ctx, addu, dh, dh, sh);
+		emit_instr(ctx, addu, dh, dh, MIPS_R_AT);
+		break;
+	case BPF_SUB:
+		emit_instr(ctx, sltu, MIPS_R_AT, dl, sl);
+		emit_instr(ctx, subu, dl, dl, sl);
+		if (sh != MIPS_R_ZERO)
+			emit_instr(ctx, subu, dh, dh, sh);
+		emit_instr(ctx, subu, dh, dh, MIPS_R_AT);
+		break;
+	case BPF_AND:
+		emit_instr(ctx, and, dl, dl, sl);
+		emit_instr(ctx, and, dh, dh, sh);
+		break;
+	case BPF_OR:
+		emit_instr(ctx, or, dl, dl, sl);
+		if (sh != MIPS_R_ZERO)
+			emit_instr(ctx, or, dh, dh, sh);
+		break;
+	case BPF_XOR:
+		emit_instr(ctx, xor, dl, dl, sl);
+		if (sh != MIPS_R_ZERO)
+			emit_instr(ctx, xor, dh, dh, sh);
+		break;
+	case BPF_MUL:
+		/* dh = dh * sl + dl * sh + hi(dl * sl), dl = lo(dl * sl) */
+		if (sh == MIPS_R_ZERO) {
+			emit_instr(ctx, mul, dh, dh, sl);
+		} else {
+			emit_instr(ctx, mul, MIPS_R_AT, dh, sl);
+			emit_instr(ctx, mul, dh, dl, sh);
+			emit_instr(ctx, addu, dh, dh, MIPS_R_AT);
+		}
+		if (MIPS_ISA_REV >= 6) {
+			emit_instr(ctx, muhu, MIPS_R_AT, dl, sl);
+			emit_instr(ctx, mulu, dl, dl, sl);
+		} else {
+			emit_instr(ctx, multu, dl, sl);
+			emit_instr(ctx, mfhi, MIPS_R_AT);
+			emit_instr(ctx, mflo, dl);
+		}
+		emit_instr(ctx, addu, dh, dh, MIPS_R_AT);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static void emit_neg64(struct jit_ctx *ctx, const u8 *dst)
+{
+	emit_instr(ctx, subu, dst[LO], MIPS_R_ZERO, dst[LO]);
+	emit_instr(ctx, sltu, MIPS_R_AT, MIPS_R_ZERO, dst[LO]);
+	emit_instr(ctx, subu, dst[HI], MIPS_R_ZERO, dst[HI]);
+	emit_instr(ctx, subu, dst[HI], dst[HI], MIPS_R_AT);
+}
+
+static int emit_shift64_imm(struct jit_ctx *ctx, int bpf_op,
+			    const u8 *dst, unsigned int n)
+{
+	int dl = dst[LO], dh = dst[HI];
+
+	n &= 0x3f;
+	if (n == 0)
+		return 0;
+
+	switch (bpf_op) {
+	case BPF_LSH:
+		if (n >= 32) {
+			emit_instr(ctx, sll, dh, dl, n - 32);
+			emit_instr(ctx, addu, dl, MIPS_R_ZERO, MIPS_R_ZERO);
+			break;
+		}
+		emit_instr(ctx, srl, MIPS_R_AT, dl, 32 - n);
+		emit_instr(ctx, sll, dh, dh, n);
+		emit_instr(ctx, or, dh, dh, MIPS_R_AT);
+		emit_instr(ctx, sll, dl, dl, n);
+		break;
+	case BPF_RSH:
+	case BPF_ARSH:
+		if (n >= 32) {
+			if (bpf_op == BPF_RSH) {
+				emit_instr(ctx, srl, dl, dh, n - 32);
+				emit_instr(ctx, addu, dh, MIPS_R_ZERO, MIPS_R_ZERO);
+			} else {
+				emit_instr(ctx, sra, dl, dh, n - 32);
+				emit_instr(ctx, sra, dh, dh, 31);
+			}
+			break;
+		}
+		emit_instr(ctx, sll, MIPS_R_AT, dh, 32 - n);
+		emit_instr(ctx, srl, dl, dl, n);
+		emit_instr(ctx, or, dl, dl, MIPS_R_AT);
+		if (bpf_op == BPF_RSH)
+			emit_instr(ctx, srl, dh, dh, n);
+		else
+			emit_instr(ctx, sra, dh, dh, n);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Shift by the low 6 bits of @n. The word crossing part is shifted by
+ * one and then by 31 - n (the low 5 bits of ~n), so it is correctly
+ * zero for a shift by 0.
+ */
+static int emit_shift64_reg(struct jit_ctx *ctx, int bpf_op,
+			    const u8 *dst, int n)
+{
+	int dl = dst[LO], dh = dst[HI];
+
+	emit_instr(ctx, andi, MIPS_R_AT, n, 32);
+	emit_instr(ctx, beq, MIPS_R_AT, MIPS_R_ZERO, 4 * 4);
+	switch (bpf_op) {
+	case BPF_LSH:
+		/* Delay slot */
+		emit_instr(ctx, srl, MIPS_R_T6, dl, 1);
+		/* n >= 32 */
+		emit_instr(ctx, sllv, dh, dl, n);
+		emit_instr(ctx, beq, MIPS_R_ZERO, MIPS_R_ZERO, 6 * 4);
+		emit_instr(ctx, addu, dl, MIPS_R_ZERO, MIPS_R_ZERO);
+		/* n < 32 */
+		emit_instr(ctx, nor, MIPS_R_AT, n, MIPS_R_ZERO);
+		emit_instr(ctx, srlv, MIPS_R_T6, MIPS_R_T6, MIPS_R_AT);
+		emit_instr(ctx, sllv, dh, dh, n);
+		emit_instr(ctx, or, dh, dh, MIPS_R_T6);
+		emit_instr(ctx, sllv, dl, dl, n);
+		break;
+	case BPF_RSH:
+	case BPF_ARSH:
+		/* Delay slot */
+		emit_instr(ctx, sll, MIPS_R_T6, dh, 1);
+		/* n >= 32 */
+		if (bpf_op == BPF_RSH) {
+			emit_instr(ctx, srlv, dl, dh, n);
+			emit_instr(ctx, beq, MIPS_R_ZERO, MIPS_R_ZERO, 6 * 4);
+			emit_instr(ctx, addu, dh, MIPS_R_ZERO, MIPS_R_ZERO);
+		} else {
+			emit_instr(ctx, srav, dl, dh, n);
+			emit_instr(ctx, beq, MIPS_R_ZERO, MIPS_R_ZERO, 6 * 4);
+			emit_instr(ctx, sra, dh, dh, 31);
+		}
+		/* n < 32, dh before dl in case n is dl */
+		emit_instr(ctx, nor, MIPS_R_AT, n, MIPS_R_ZERO);
+		emit_instr(ctx, sllv, MIPS_R_T6, MIPS_R_T6, MIPS_R_AT);
+		if (bpf_op == BPF_RSH)
+			emit_instr(ctx, srlv, dh, dh, n);
+		else
+			emit_instr(ctx, srav, dh, dh, n);
+		emit_instr(ctx, srlv, dl, dl, n);
+		emit_instr(ctx, or, dl, dl, MIPS_R_T6);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static u64 jit_udiv64(u64 dividend, u64 divisor)
+{
+	return div64_u64(dividend, divisor);
+}
+
+static u64 jit_umod64(u64 dividend, u64 divisor)
+{
+	u64 rem;
+
+	div64_u64_rem(dividend, divisor, &rem);
+	return rem;
+}
+
+/*
+ * There is no 64-bit divide, call out to C. The caller saved registers
+ * holding eBPF registers are preserved around the call, except for
+ * those of @dst.
+ */
+static void emit_div64(struct jit_ctx *ctx, int bpf_op,
+		       const u8 *dst, const u8 *src)
+{
+	const u8 *arg1 = bpf2mips32[BPF_REG_1];
+	const u8 *arg2 = bpf2mips32[BPF_REG_2];
+	void *func = bpf_op == BPF_DIV ? jit_udiv64 : jit_umod64;
+	int i, r;
+
+	ctx->flags |= EBPF_SEEN_DIV64;
+	ctx->saved_regs |= BIT(MIPS_R_RA);
+
+	for (i = 0; i < ARRAY_SIZE(div64_saved); i++) {
+		r = div64_saved[i];
+		if (r != dst[0] && r != dst[1])
+			emit_instr(ctx, sw, r, ctx->div64_off + 4 * i,
+				   MIPS_R_SP);
+	}
+
+	/* The divisor first, the dividend may be in $a2/$a3 */
+	for (i = 0; i < 2; i++)
+		if (src[i] != tmp_pair[i])
+			emit_instr(ctx, addu, tmp_pair[i], src[i], MIPS_R_ZERO);
+	for (i = 0; i < 2; i++)
+		if (dst[i] != arg1[i])
+			emit_instr(ctx, addu, arg1[i], dst[i], MIPS_R_ZERO);
+	for (i = 0; i < 2; i++)
+		emit_instr(ctx, addu, arg2[i], tmp_pair[i], MIPS_R_ZERO);
+
+	gen_imm_to_reg(ctx, MIPS_R_T9, (s32)(long)func);
+	emit_instr(ctx, jalr, MIPS_R_RA, MIPS_R_T9);
+	/* Delay slot */
+	emit_instr(ctx, nop);
+
+	for (i = 0; i < 2; i++)
+		emit_instr(ctx, addu, tmp_pair[i], bpf2mips32[BPF_REG_0][i],
+			   MIPS_R_ZERO);
+	for (i = 0; i < ARRAY_SIZE(div64_saved); i++) {
+		r = div64_saved[i];
+		if (r != dst[0] && r != dst[1])
+			emit_instr(ctx, lw, r, ctx->div64_off + 4 * i,
+				   MIPS_R_SP);
+	}
+	for (i = 0; i < 2; i++)
+		emit_instr(ctx, addu, dst[i], tmp_pair[i], MIPS_R_ZERO);
+}
+
+/* Byte swap a word, clobbers $at and $t6 before MIPS32r2 */
+static void emit_bswap32(struct jit_ctx *ctx, int dst, int src)
+{
+	if (MIPS_ISA_REV >= 2) {
+		emit_instr(ctx, wsbh, dst, src);
+		emit_instr(ctx, rotr, dst, dst, 16);
+		return;
+	}
+	emit_instr(ctx, sll, MIPS_R_AT, src, 24);
+	emit_instr(ctx, srl, MIPS_R_T6, src, 24);
+	emit_instr(ctx, or, MIPS_R_AT, MIPS_R_AT, MIPS_R_T6);
+	emit_instr(ctx, andi, MIPS_R_T6, src, 0xff00);
+	emit_instr(ctx, sll, MIPS_R_T6, MIPS_R_T6, 8);
+	emit_instr(ctx, or, MIPS_R_AT, MIPS_R_AT, MIPS_R_T6);
+	emit_instr(ctx, srl, MIPS_R_T6, src, 8);
+	emit_instr(ctx, andi, MIPS_R_T6, MIPS_R_T6, 0xff00);
+	emit_instr(ctx, or, dst, MIPS_R_AT, MIPS_R_T6);
+}
+
+static void emit_bswap16(struct jit_ctx *ctx, int dst)
+{
+	if (MIPS_ISA_REV >= 2) {
+		emit_instr(ctx, wsbh, dst, dst);
+		emit_instr(ctx, andi, dst, dst, 0xffff);
+		return;
+	}
+	emit_instr(ctx, andi, MIPS_R_AT, dst, 0xff);
+	emit_instr(ctx, sll, MIPS_R_AT, MIPS_R_AT, 8);
+	emit_instr(ctx, srl, MIPS_R_T6, dst, 8);
+	emit_instr(ctx, andi, MIPS_R_T6, MIPS_R_T6, 0xff);
+	emit_instr(ctx, or, dst, MIPS_R_AT, MIPS_R_T6);
+}
+
+/*
+ * Branch to eBPF insn @tgt if @rs and @rt are equal (@eq) or not. Out
+ * of range branches are inverted to skip over an absolute jump.
+ */
+static int emit_bcond(struct jit_ctx *ctx, bool eq, int rs, int rt,
+		      int this_idx, int tgt)
+{
+	unsigned int target = 0;
+	int b_off;
+
+	b_off = b_imm(tgt, ctx);
+	if (is_bad_offset(b_off) ||
+	    (ctx->offsets[this_idx] & OFFSETS_B_CONV)) {
+		target = j_target(ctx, tgt);
+		if (target == (unsigned int)-1)
+			return -E2BIG;
+		eq = !eq;
+		b_off = 4 * 3;
+		if (!(ctx->offsets[this_idx] & OFFSETS_B_CONV)) {
+			ctx->offsets[this_idx] |= OFFSETS_B_CONV;
+			ctx->long_b_conversion = 1;
+		}
+	}
+
+	if (eq)
+		emit_instr(ctx, beq, rs, rt, b_off);
+	else
+		emit_instr(ctx, bne, rs, rt, b_off);
+	emit_instr(ctx, nop);
+	if (ctx->offsets[this_idx] & OFFSETS_B_CONV) {
+		emit_instr(ctx, j, target);
+		emit_instr(ctx, nop);
+	}
+	return 0;
+}
+
+static int emit_ja(struct jit_ctx *ctx, int tgt)
+{
+	unsigned int target;
+	int b_off;
+
+	/*
+	 * Prefer relative branch for easier debugging, but
+	 * fall back if needed.
+	 */
+	b_off = b_imm(tgt, ctx);
+	if (is_bad_offset(b_off)) {
+		target = j_target(ctx, tgt);
+		if (target == (unsigned int)-1)
+			return -E2BIG;
+		emit_instr(ctx, j, target);
+	} else {
+		emit_instr(ctx, b, b_off);
+	}
+	emit_instr(ctx, nop);
+	return 0;
+}
+
+/* Is the comparison true when $at is set after emit_jmp_cmp()? */
+static bool jmp_on_set(int bpf_op)
+{
+	switch (bpf_op) {
+	case BPF_JGE:
+	case BPF_JLE:
+	case BPF_JSGE:
+	case BPF_JSLE:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/*
+ * Set $at for an ordered comparison of @dst and @src, 64-bit unless
+ * @jmp32. Only the high words are compared signed.
+ */
+static void emit_jmp_cmp(struct jit_ctx *ctx, int bpf_op,
+			 const u8 *dst, const u8 *src, bool jmp32)
+{
+	bool sign = bpf_op == BPF_JSGT || bpf_op == BPF_JSGE ||
+		    bpf_op == BPF_JSLT || bpf_op == BPF_JSLE;
+	const u8 *a = dst, *b = src;
+
+	/* $at = a < b */
+	if (bpf_op == BPF_JGT || bpf_op == BPF_JLE ||
+	    bpf_op == BPF_JSGT || bpf_op == BPF_JSLE) {
+		a = src;
+		b = dst;
+	}
+
+	if (jmp32) {
+		if (sign)
+			emit_instr(ctx, slt, MIPS_R_AT, a[LO], b[LO]);
+		else
+			emit_instr(ctx, sltu, MIPS_R_AT, a[LO], b[LO]);
+		return;
+	}
+
+	/* The low words decide only if the high words are equal */
+	emit_instr(ctx, beq, a[HI], b[HI], 2 * 4);
+	/* Delay slot */
+	emit_instr(ctx, sltu, MIPS_R_AT, a[LO], b[LO]);
+	if (sign)
+		emit_instr(ctx, slt, MIPS_R_AT, a[HI], b[HI]);
+	else
+		emit_instr(ctx, sltu, MIPS_R_AT, a[HI], b[HI]);
+}
+
+static int emit_jmp(struct jit_ctx *ctx, int bpf_op, const u8 *dst,
+		    const u8 *src, bool jmp32, int this_idx, int tgt)
+{
+	switch (bpf_op) {
+	case BPF_JEQ:
+	case BPF_JNE:
+		if (jmp32)
+			return emit_bcond(ctx, bpf_op == BPF_JEQ,
+					  dst[LO], src[LO], this_idx, tgt);
+		emit_instr(ctx, xor, MIPS_R_AT, dst[HI], src[HI]);
+		emit_instr(ctx, xor, MIPS_R_T6, dst[LO], src[LO]);
+		emit_instr(ctx, or, MIPS_R_AT, MIPS_R_AT, MIPS_R_T6);
+		return emit_bcond(ctx, bpf_op == BPF_JEQ,
+				  MIPS_R_AT, MIPS_R_ZERO, this_idx, tgt);
+	case BPF_JSET:
+		if (jmp32) {
+			emit_instr(ctx, and, MIPS_R_AT, dst[LO], src[LO]);
+		} else {
+			emit_instr(ctx, and, MIPS_R_AT, dst[HI], src[HI]);
+			emit_instr(ctx, and, MIPS_R_T6, dst[LO], src[LO]);
+			emit_instr(ctx, or, MIPS_R_AT, MIPS_R_AT, MIPS_R_T6);
+		}
+		return emit_bcond(ctx, false, MIPS_R_AT, MIPS_R_ZERO,
+				  this_idx, tgt);
+	case BPF_JGT:
+	case BPF_JGE:
+	case BPF_JLT:
+	case BPF_JLE:
+	case BPF_JSGT:
+	case BPF_JSGE:
+	case BPF_JSLT:
+	case BPF_JSLE:
+		emit_jmp_cmp(ctx, bpf_op, dst, src, jmp32);
+		return emit_bcond(ctx, !jmp_on_set(bpf_op),
+				  MIPS_R_AT, MIPS_R_ZERO, this_idx, tgt);
+	default:
+		return -EINVAL;
+	}
+}
+
+static int emit_bpf_tail_call(struct jit_ctx *ctx, int this_idx)
+{
+	int arr = bpf2mips32[BPF_REG_2][LO];
+	int index = bpf2mips32[BPF_REG_3][LO];
+	int ctx_reg = bpf2mips32[BPF_REG_1][LO];
+	int off, b_off;
+
+	ctx->flags |= EBPF_SEEN_TC;
+	/*
+	 * if (index >= array->map.max_entries)
+	 *     goto out;
+	 */
+	off = offsetof(struct bpf_array, map.max_entries);
+	emit_instr(ctx, lw, MIPS_R_AT, off, arr);
+	emit_instr(ctx, sltu, MIPS_R_AT, index, MIPS_R_AT);
+	b_off = b_imm(this_idx + 1, ctx);
+	emit_instr(ctx, beq, MIPS_R_AT, MIPS_R_ZERO, b_off);
+	/*
+	 * if (TCC-- < 0)
+	 *     goto out;
+	 */
+	/* Delay slot */
+	emit_instr(ctx, lw, MIPS_R_T6, ctx->tcc_off, MIPS_R_SP);
+	b_off = b_imm(this_idx + 1, ctx);
+	emit_instr(ctx, bltz, MIPS_R_T6, b_off);
+	/*
+	 * prog = array->ptrs[index];
+	 * if (prog == NULL)
+	 *     goto out;
+	 */
+	/* Delay slot */
+	emit_instr(ctx, sll, MIPS_R_AT, index, 2);
+	emit_instr(ctx, addu, MIPS_R_AT, MIPS_R_AT, arr);
+	off = offsetof(struct bpf_array, ptrs);
+	emit_instr(ctx, lw, MIPS_R_AT, off, MIPS_R_AT);
+	b_off = b_imm(this_idx + 1, ctx);
+	emit_instr(ctx, beq, MIPS_R_AT, MIPS_R_ZERO, b_off);
+	/* Delay slot */
+	emit_instr(ctx, nop);
+
+	/* goto *(prog->bpf_func + 4); */
+	off = offsetof(struct bpf_prog, bpf_func);
+	emit_instr(ctx, lw, MIPS_R_T9, off, MIPS_R_AT);
+	/* All systems are go... propagate TCC and the context */
+	emit_instr(ctx, addiu, MIPS_R_V1, MIPS_R_T6, -1);
+	if (ctx_reg != MIPS_R_A0)
+		emit_instr(ctx, addu, MIPS_R_A0, ctx_reg, MIPS_R_ZERO);
+	/* Skip first instruction (TCC initialization) */
+	emit_instr(ctx, addiu, MIPS_R_T9, MIPS_R_T9, 4);
+	return build_int_epilogue(ctx, MIPS_R_T9);
+}
+
+/* Returns the number of insn slots consumed. */
+static int build_one_insn(const struct bpf_insn *insn, struct jit_ctx *ctx,
+			  int this_idx, int exit_idx)
+{
+	const u8 *src, *dst;
+	u8 imm_pair[2];
+	bool need_swap;
+	int mem_off, r, i;
+	s32 func;
+	int bpf_op = BPF_OP(insn->code);
+
+	switch (insn->code) {
+	case BPF_ALU | BPF_MOV | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_ADD | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_SUB | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_OR | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_AND | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_LSH | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_RSH | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_XOR | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_ARSH | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_MUL | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_DIV | BPF_K: /* ALU32_IMM */
+	case BPF_ALU | BPF_MOD | BPF_K: /* ALU32_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		r = emit_alu32_imm(ctx, bpf_op, dst[LO], insn->imm);
+		if (r < 0)
+			return r;
+		emit_zext_32(ctx, dst);
+		break;
+	case BPF_ALU | BPF_MOV | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_ADD | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_SUB | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_XOR | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_OR | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_AND | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_MUL | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_DIV | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_MOD | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_LSH | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_RSH | BPF_X: /* ALU32_REG */
+	case BPF_ALU | BPF_ARSH | BPF_X: /* ALU32_REG */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		if (insn_is_zext(insn)) {
+			/* Zero extension inserted by the verifier */
+			emit_instr(ctx, addu, dst[HI], MIPS_R_ZERO, MIPS_R_ZERO);
+			break;
+		}
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		r = emit_alu32_reg(ctx, bpf_op, dst[LO], src[LO]);
+		if (r < 0)
+			return r;
+		emit_zext_32(ctx, dst);
+		break;
+	case BPF_ALU | BPF_NEG | BPF_K: /* ALU32_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		emit_instr(ctx, subu, dst[LO], MIPS_R_ZERO, dst[LO]);
+		emit_zext_32(ctx, dst);
+		break;
+	case BPF_ALU64 | BPF_MOV | BPF_K: /* ALU64_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		gen_imm_to_reg(ctx, dst[LO], insn->imm);
+		emit_instr(ctx, addiu, dst[HI], MIPS_R_ZERO,
+			   insn->imm < 0 ? -1 : 0);
+		break;
+	case BPF_ALU64 | BPF_ADD | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_SUB | BPF_K: /* ALU64_IMM */
+		if (insn->imm == 0)
+			break;
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		i = bpf_op == BPF_ADD ? insn->imm : -insn->imm;
+		if (i >= S16_MIN && i <= S16_MAX) {
+			/* Carry out of the low word if it wrapped */
+			emit_instr(ctx, addiu, dst[LO], dst[LO], i);
+			emit_instr(ctx, sltiu, MIPS_R_AT, dst[LO], i);
+			emit_instr(ctx, addu, dst[HI], dst[HI], MIPS_R_AT);
+			if (i < 0)
+				emit_instr(ctx, addiu, dst[HI], dst[HI], -1);
+			break;
+		}
+		gen_imm_pair(ctx, insn->imm, imm_pair);
+		r = emit_alu64_reg(ctx, bpf_op, dst, imm_pair);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_ALU64 | BPF_AND | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_OR | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_XOR | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_MUL | BPF_K: /* ALU64_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		gen_imm_pair(ctx, insn->imm, imm_pair);
+		r = emit_alu64_reg(ctx, bpf_op, dst, imm_pair);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_ALU64 | BPF_LSH | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_RSH | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_ARSH | BPF_K: /* ALU64_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		r = emit_shift64_imm(ctx, bpf_op, dst, insn->imm);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_ALU64 | BPF_NEG | BPF_K: /* ALU64_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		emit_neg64(ctx, dst);
+		break;
+	case BPF_ALU64 | BPF_DIV | BPF_K: /* ALU64_IMM */
+	case BPF_ALU64 | BPF_MOD | BPF_K: /* ALU64_IMM */
+		if (insn->imm == 0)
+			return -EINVAL;
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		if (insn->imm == 1) {
+			/* div by 1 is a nop, mod by 1 is zero */
+			if (bpf_op == BPF_MOD) {
+				gen_imm_pair(ctx, 0, imm_pair);
+				emit_alu64_reg(ctx, BPF_MOV, dst, imm_pair);
+			}
+			break;
+		}
+		gen_imm_pair(ctx, insn->imm, imm_pair);
+		emit_div64(ctx, bpf_op, dst, imm_pair);
+		break;
+	case BPF_ALU64 | BPF_MOV | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_ADD | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_SUB | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_XOR | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_OR | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_AND | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_MUL | BPF_X: /* ALU64_REG */
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		r = emit_alu64_reg(ctx, bpf_op, dst, src);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_ALU64 | BPF_LSH | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_RSH | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_ARSH | BPF_X: /* ALU64_REG */
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		r = emit_shift64_reg(ctx, bpf_op, dst, src[LO]);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_ALU64 | BPF_DIV | BPF_X: /* ALU64_REG */
+	case BPF_ALU64 | BPF_MOD | BPF_X: /* ALU64_REG */
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		emit_div64(ctx, bpf_op, dst, src);
+		break;
+	case BPF_JMP | BPF_EXIT:
+		if (this_idx + 1 < exit_idx) {
+			r = emit_ja(ctx, exit_idx);
+			if (r < 0)
+				return r;
+		}
+		break;
+	case BPF_JMP | BPF_JEQ | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JNE | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JSET | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JGT | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JGE | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JLT | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JLE | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JSGT | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JSGE | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JSLT | BPF_K: /* JMP_IMM */
+	case BPF_JMP | BPF_JSLE | BPF_K: /* JMP_IMM */
+	case BPF_JMP32 | BPF_JEQ | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JNE | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JSET | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JGT | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JGE | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JLT | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JLE | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JSGT | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JSGE | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JSLT | BPF_K: /* JMP32_IMM */
+	case BPF_JMP32 | BPF_JSLE | BPF_K: /* JMP32_IMM */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		gen_imm_pair(ctx, insn->imm, imm_pair);
+		r = emit_jmp(ctx, bpf_op, dst, imm_pair,
+			     BPF_CLASS(insn->code) == BPF_JMP32,
+			     this_idx, this_idx + insn->off + 1);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_JMP | BPF_JEQ | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JNE | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JSET | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JGT | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JGE | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JLT | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JLE | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JSGT | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JSGE | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JSLT | BPF_X: /* JMP_REG */
+	case BPF_JMP | BPF_JSLE | BPF_X: /* JMP_REG */
+	case BPF_JMP32 | BPF_JEQ | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JNE | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JSET | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JGT | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JGE | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JLT | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JLE | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JSGT | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JSGE | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JSLT | BPF_X: /* JMP32_REG */
+	case BPF_JMP32 | BPF_JSLE | BPF_X: /* JMP32_REG */
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		r = emit_jmp(ctx, bpf_op, dst, src,
+			     BPF_CLASS(insn->code) == BPF_JMP32,
+			     this_idx, this_idx + insn->off + 1);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_JMP | BPF_JA:
+		r = emit_ja(ctx, this_idx + insn->off + 1);
+		if (r < 0)
+			return r;
+		break;
+	case BPF_LD | BPF_DW | BPF_IMM:
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		gen_imm_to_reg(ctx, dst[LO], insn->imm);
+		gen_imm_to_reg(ctx, dst[HI], (insn + 1)->imm);
+		return 2; /* Double slot insn */
+
+	case BPF_JMP | BPF_CALL:
+		/* No bpf-to-bpf calls, leave those to the interpreter */
+		if (insn->src_reg == BPF_PSEUDO_CALL)
+			return -EINVAL;
+		ctx->saved_regs |= BIT(MIPS_R_RA);
+		/* o32 passes the third to fifth argument on the stack */
+		for (i = BPF_REG_3; i <= BPF_REG_5; i++) {
+			src = bpf2mips32[i];
+			mem_off = 16 + 8 * (i - BPF_REG_3);
+			emit_instr(ctx, sw, src[0], mem_off, MIPS_R_SP);
+			emit_instr(ctx, sw, src[1], mem_off + 4, MIPS_R_SP);
+		}
+		func = (s32)((long)__bpf_call_base + insn->imm);
+		gen_imm_to_reg(ctx, MIPS_R_T9, func);
+		emit_instr(ctx, jalr, MIPS_R_RA, MIPS_R_T9);
+		/* delay slot */
+		emit_instr(ctx, nop);
+		break;
+
+	case BPF_JMP | BPF_TAIL_CALL:
+		if (emit_bpf_tail_call(ctx, this_idx))
+			return -EINVAL;
+		break;
+
+	case BPF_ALU | BPF_END | BPF_FROM_BE:
+	case BPF_ALU | BPF_END | BPF_FROM_LE:
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+#ifdef __BIG_ENDIAN
+		need_swap = (BPF_SRC(insn->code) == BPF_FROM_LE);
+#else
+		need_swap = (BPF_SRC(insn->code) == BPF_FROM_BE);
+#endif
+		if (insn->imm == 16) {
+			if (need_swap)
+				emit_bswap16(ctx, dst[LO]);
+			else
+				emit_instr(ctx, andi, dst[LO], dst[LO], 0xffff);
+			emit_zext_32(ctx, dst);
+		} else if (insn->imm == 32) {
+			if (need_swap)
+				emit_bswap32(ctx, dst[LO], dst[LO]);
+			emit_zext_32(ctx, dst);
+		} else { /* 64-bit*/
+			if (need_swap) {
+				emit_bswap32(ctx, MIPS_R_T7, dst[LO]);
+				emit_bswap32(ctx, dst[LO], dst[HI]);
+				emit_instr(ctx, addu, dst[HI], MIPS_R_T7,
+					   MIPS_R_ZERO);
+			}
+		}
+		break;
+
+	case BPF_ST | BPF_B | BPF_MEM:
+	case BPF_ST | BPF_H | BPF_MEM:
+	case BPF_ST | BPF_W | BPF_MEM:
+	case BPF_ST | BPF_DW | BPF_MEM:
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		gen_imm_pair(ctx, insn->imm, imm_pair);
+		mem_off = insn->off;
+		switch (BPF_SIZE(insn->code)) {
+		case BPF_B:
+			emit_instr(ctx, sb, imm_pair[LO], mem_off, dst[LO]);
+			break;
+		case BPF_H:
+			emit_instr(ctx, sh, imm_pair[LO], mem_off, dst[LO]);
+			break;
+		case BPF_W:
+			emit_instr(ctx, sw, imm_pair[LO], mem_off, dst[LO]);
+			break;
+		case BPF_DW:
+			if (mem_off > S16_MAX - 4)
+				return -EINVAL;
+			emit_instr(ctx, sw, imm_pair[0], mem_off, dst[LO]);
+			emit_instr(ctx, sw, imm_pair[1], mem_off + 4, dst[LO]);
+			break;
+		}
+		break;
+
+	case BPF_LDX | BPF_B | BPF_MEM:
+	case BPF_LDX | BPF_H | BPF_MEM:
+	case BPF_LDX | BPF_W | BPF_MEM:
+	case BPF_LDX | BPF_DW | BPF_MEM:
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		mem_off = insn->off;
+		switch (BPF_SIZE(insn->code)) {
+		case BPF_B:
+			emit_instr(ctx, lbu, dst[LO], mem_off, src[LO]);
+			break;
+		case BPF_H:
+			emit_instr(ctx, lhu, dst[LO], mem_off, src[LO]);
+			break;
+		case BPF_W:
+			emit_instr(ctx, lw, dst[LO], mem_off, src[LO]);
+			break;
+		case BPF_DW:
+			if (mem_off > S16_MAX - 4)
+				return -EINVAL;
+			/* Don't clobber the base before the second load */
+			if (dst[0] == src[LO]) {
+				emit_instr(ctx, lw, dst[1], mem_off + 4, src[LO]);
+				emit_instr(ctx, lw, dst[0], mem_off, src[LO]);
+			} else {
+				emit_instr(ctx, lw, dst[0], mem_off, src[LO]);
+				emit_instr(ctx, lw, dst[1], mem_off + 4, src[LO]);
+			}
+			break;
+		}
+		if (BPF_SIZE(insn->code) != BPF_DW)
+			emit_zext_32(ctx, dst);
+		break;
+
+	case BPF_STX | BPF_B | BPF_MEM:
+	case BPF_STX | BPF_H | BPF_MEM:
+	case BPF_STX | BPF_W | BPF_MEM:
+	case BPF_STX | BPF_DW | BPF_MEM:
+	case BPF_STX | BPF_W | BPF_XADD:
+		/*
+		 * There is no 64-bit ll/sc on 32-bit MIPS, BPF_DW XADD
+		 * is left to the interpreter like on the other 32-bit
+		 * JITs.
+		 */
+		dst = ebpf_to_mips_reg(ctx, insn->dst_reg);
+		src = ebpf_to_mips_reg(ctx, insn->src_reg);
+		mem_off = insn->off;
+		if (BPF_MODE(insn->code) == BPF_XADD) {
+			int base = dst[LO];
+
+			/*
+			 * If mem_off does not fit within the 9 bit ll/sc
+			 * instruction immediate field, use a temp reg.
+			 */
+			if (MIPS_ISA_REV >= 6 &&
+			    (mem_off >= BIT(8) || mem_off < -BIT(8))) {
+				emit_instr(ctx, addiu, MIPS_R_T7, base, mem_off);
+				mem_off = 0;
+				base = MIPS_R_T7;
+			}
+			emit_instr(ctx, ll, MIPS_R_T6, mem_off, base);
+			emit_instr(ctx, addu, MIPS_R_T6, MIPS_R_T6, src[LO]);
+			emit_instr(ctx, sc, MIPS_R_T6, mem_off, base);
+			/*
+			 * On failure back up to LL (-4
+			 * instructions of 4 bytes each
+			 */
+			emit_instr(ctx, beq, MIPS_R_T6, MIPS_R_ZERO, -4 * 4);
+			emit_instr(ctx, nop);
+			break;
+		}
+		switch (BPF_SIZE(insn->code)) {
+		case BPF_B:
+			emit_instr(ctx, sb, src[LO], mem_off, dst[LO]);
+			break;
+		case BPF_H:
+			emit_instr(ctx, sh, src[LO], mem_off, dst[LO]);
+			break;
+		case BPF_W:
+			emit_instr(ctx, sw, src[LO], mem_off, dst[LO]);
+			break;
+		case BPF_DW:
+			if (mem_off > S16_MAX - 4)
+				return -EINVAL;
+			emit_instr(ctx, sw, src[0], mem_off, dst[LO]);
+			emit_instr(ctx, sw, src[1], mem_off + 4, dst[LO]);
+			break;
+		}
+		break;
+
+	default:
+		return -EINVAL;
+	}
+	return 1;
+}
+
+static int build_int_body(struct jit_ctx *ctx)
+{
+	const struct bpf_prog *prog = ctx->skf;
+	const struct bpf_insn *insn;
+	int i, r;
+
+	for (i = 0; i < prog->len; ) {
+		insn = prog->insnsi + i;
+		if (ctx->target == NULL)
+			ctx->offsets[i] = (ctx->offsets[i] & OFFSETS_B_CONV) |
+					  (ctx->idx * 4);
+
+		r = build_one_insn(insn, ctx, i, prog->len);
+		if (r < 0)
+			return r;
+		i += r;
+	}
+	/* epilogue offset */
+	if (ctx->target == NULL)
+		ctx->offsets[i] = ctx->idx * 4;
+
+	return 0;
+}
+
+static void jit_fill_hole(void *area, unsigned int size)
+{
+	u32 *p;
+
+	/* We are guaranteed to have aligned memory. */
+	for (p = area; size >= sizeof(u32); size -= sizeof(u32))
+		uasm_i_break(&p, BRK_BUG); /* Increments p */
+}
+
+bool bpf_jit_needs_zext(void)
+{
+	return true;
+}
+
+struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
+{
+	struct bpf_prog *orig_prog = prog;
+	bool tmp_blinded = false;
+	struct bpf_prog *tmp;
+	struct bpf_binary_header *header = NULL;
+	struct jit_ctx ctx;
+	unsigned int image_size;
+	u8 *image_ptr;
+
+	if (!prog->jit_requested)
+		return prog;
+
+	tmp = bpf_jit_blind_constants(prog);
+	/* If blinding was requested and we failed during blinding,
+	 * we must fall back to the interpreter.
+	 */
+	if (IS_ERR(tmp))
+		return orig_prog;
+	if (tmp != prog) {
+		tmp_blinded = true;
+		prog = tmp;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	ctx.offsets = kcalloc(prog->len + 1, sizeof(*ctx.offsets), GFP_KERNEL);
+	if (ctx.offsets == NULL)
+		goto out_err;
+
+	ctx.skf = prog;
+
+	/*
+	 * First pass discovers used resources and instruction offsets
+	 * assuming short branches are used.
+	 */
+	if (build_int_body(&ctx))
+		goto out_err;
+
+	/*
+	 * Second pass generates offsets, if any branches are out of
+	 * range a jump-around long sequence is generated, and we have
+	 * to try again from the beginning to generate the new
+	 * offsets.  This is done until no additional conversions are
+	 * necessary.
+	 */
+	do {
+		ctx.idx = 0;
+		ctx.gen_b_offsets = 1;
+		ctx.long_b_conversion = 0;
+		if (gen_int_prologue(&ctx))
+			goto out_err;
+		if (build_int_body(&ctx))
+			goto out_err;
+		if (build_int_epilogue(&ctx, MIPS_R_RA))
+			goto out_err;
+	} while (ctx.long_b_conversion);
+
+	image_size = 4 * ctx.idx;
+
+	header = bpf_jit_binary_alloc(image_size, &image_ptr,
+				      sizeof(u32), jit_fill_hole);
+	if (header == NULL)
+		goto out_err;
+
+	ctx.target = (u32 *)image_ptr;
+
+	/* Third pass generates the code */
+	ctx.idx = 0;
+	if (gen_int_prologue(&ctx))
+		goto out_err;
+	if (build_int_body(&ctx))
+		goto out_err;
+	if (build_int_epilogue(&ctx, MIPS_R_RA))
+		goto out_err;
+
+	/* Update the icache */
+	flush_icache_range((unsigned long)ctx.target,
+			   (unsigned long)&ctx.target[ctx.idx]);
+
+	if (bpf_jit_enable > 1)
+		/* Dump JIT code */
+		bpf_jit_dump(prog->len, image_size, 2, ctx.target);
+
+	bpf_jit_binary_lock_ro(header);
+	prog->bpf_func = (void *)ctx.target;
+	prog->jited = 1;
+	prog->jited_len = image_size;
+out_normal:
+	if (tmp_blinded)
+		bpf_jit_prog_release_other(prog, prog == orig_prog ?
+					   tmp : orig_prog);
+	kfree(ctx.offsets);
+
+	return prog;
+
+out_err:
+	prog = orig_prog;
+	if (header)
+		bpf_jit_binary_free(header);
+	goto out_normal;
+}
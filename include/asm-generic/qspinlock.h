@@ -66,6 +66,7 @@ static __always_inline int queued_spin_trylock(struct qspinlock *lock)
 }
 
 extern void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+extern void __cna_queued_spin_lock_slowpath(struct qspinlock *lock, u32 val);
 
 /**
  * queued_spin_lock - acquire a queued spinlock
@@ -55,6 +55,7 @@ struct can_dev_rcv_lists {
 	struct hlist_head rx[RX_MAX];
 	struct hlist_head rx_sff[CAN_SFF_RCV_ARRAY_SZ];
 	struct hlist_head rx_eff[CAN_EFF_RCV_ARRAY_SZ];
+	struct hlist_head rx_fil_groups; /* RX_FIL entries hashed per mask */
 	int entries;
 };
 
@@ -333,4 +333,57 @@ void net_dim(struct dim *dim, struct dim_sample end_sample);
  */
 void rdma_dim(struct dim *dim, u64 completions);
 
+/* IRQ DIM */
+
+#define IRQ_DIM_START_PROFILE 0
+
+#ifdef CONFIG_IRQ_TIMINGS
+/**
+ *	irq_dim_get_moderation - provide the CQ moderation of an IRQ DIM profile
+ *	@ix: Profile index
+ */
+struct dim_cq_moder irq_dim_get_moderation(int ix);
+
+/**
+ *	irq_dim_init - initialize an IRQ DIM instance
+ *	@dim: The moderation struct
+ *	@func: Work function applying the moderation of dim->profile_ix
+ *
+ * Also enables the irq timings, which the moderation decisions are based on.
+ */
+void irq_dim_init(struct dim *dim, work_func_t func);
+
+/**
+ * irq_dim - Runs the adaptive moderation from the predicted interrupt rate.
+ * @dim: The moderation struct.
+ * @irq: The interrupt whose rate is moderated.
+ *
+ * To be called from the handler of @irq for every interrupt. Once enough
+ * events have been collected, the interval to the next interrupt predicted
+ * by the irq timings is mapped to a moderation profile and dim->profile_ix
+ * is moved one step towards it. When it changes, dim->work is scheduled;
+ * it applies irq_dim_get_moderation(dim->profile_ix) to the device and sets
+ * dim->state back to DIM_START_MEASURE.
+ */
+void irq_dim(struct dim *dim, unsigned int irq);
+#else
+/*
+ * Without CONFIG_IRQ_TIMINGS there is no predicted interval to go by, so
+ * the device stays at the start profile, i.e. without moderation.
+ */
+static inline struct dim_cq_moder irq_dim_get_moderation(int ix)
+{
+	return (struct dim_cq_moder){ .usec = 1, .pkts = 1 };
+}
+
+static inline void irq_dim_init(struct dim *dim, work_func_t func)
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->profile_ix = IRQ_DIM_START_PROFILE;
+	INIT_WORK(&dim->work, func);
+}
+
+static inline void irq_dim(struct dim *dim, unsigned int irq) { }
+#endif /* CONFIG_IRQ_TIMINGS */
+
 #endif /* DIM_H */
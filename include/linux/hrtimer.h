@@ -406,6 +406,9 @@ static inline void destroy_hrtimer_on_stack(struct hrtimer *timer) { }
 /* Basic timer operations: */
 extern void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 				   u64 range_ns, const enum hrtimer_mode mode);
+extern void hrtimer_start_bulk(struct hrtimer **timers, const ktime_t *tims,
+			       unsigned int nr, u64 slack_ns,
+			       const enum hrtimer_mode mode);
 
 /**
  * hrtimer_start - (re)start an hrtimer
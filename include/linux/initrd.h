@@ -29,4 +29,10 @@ extern unsigned int real_root_dev;
 extern char __initramfs_start[];
 extern unsigned long __initramfs_size;
 
+#ifdef CONFIG_BLK_DEV_INITRD
+extern void wait_for_initramfs(void);
+#else
+static inline void wait_for_initramfs(void) {}
+#endif
+
 void console_on_rootfs(void);
@@ -747,6 +747,7 @@ static inline void init_irq_proc(void)
 void irq_timings_enable(void);
 void irq_timings_disable(void);
 u64 irq_timings_next_event(u64 now);
+u64 irq_timings_interval(unsigned int irq);
 #endif
 
 struct seq_file;
@@ -94,6 +94,12 @@ struct irq_desc {
 #ifdef CONFIG_PROC_FS
 	struct proc_dir_entry	*dir;
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	unsigned int		balance_count;	/* count at the last pass */
+	unsigned int		balance_delta;	/* count of the last interval */
+	unsigned long		balance_moved;	/* pass of the last move */
+	bool			balance_user;	/* pinned from user space */
+#endif
 #ifdef CONFIG_GENERIC_IRQ_DEBUGFS
 	struct dentry		*debugfs_file;
 	const char		*dev_name;
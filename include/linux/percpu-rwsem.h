@@ -15,6 +15,7 @@ struct percpu_rw_semaphore {
 	struct rcuwait		writer;
 	wait_queue_head_t	waiters;
 	atomic_t		block;
+	bool			hybrid;
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
@@ -128,6 +129,7 @@ extern int __percpu_init_rwsem(struct percpu_rw_semaphore *,
 				const char *, struct lock_class_key *);
 
 extern void percpu_free_rwsem(struct percpu_rw_semaphore *);
+extern void percpu_rwsem_set_hybrid(struct percpu_rw_semaphore *);
 
 #define percpu_init_rwsem(sem)					\
 ({								\
@@ -595,6 +595,7 @@ struct swevent_hlist {
 
 struct perf_cgroup;
 struct perf_buffer;
+struct perf_group_mapping;
 
 struct pmu_event_list {
 	raw_spinlock_t		lock;
@@ -705,6 +706,7 @@ struct perf_event {
 	/* mmap bits */
 	struct mutex			mmap_mutex;
 	atomic_t			mmap_count;
+	struct perf_group_mapping	*group_mapping;
 
 	struct perf_buffer		*rb;
 	struct list_head		rb_entry;
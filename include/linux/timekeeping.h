@@ -70,6 +70,8 @@ extern ktime_t ktime_get_coarse_with_offset(enum tk_offsets offs);
 extern ktime_t ktime_mono_to_any(ktime_t tmono, enum tk_offsets offs);
 extern ktime_t ktime_get_raw(void);
 extern u32 ktime_get_resolution_ns(void);
+extern ktime_t ktime_get_cached(void);
+extern ktime_t ktime_get_cached_refresh(void);
 
 /**
  * ktime_get_real - get the real (wall-) time in ktime_t format
@@ -195,6 +195,23 @@ static int msg_insert(struct msg_msg *msg, struct mqueue_inode_info *info)
 	struct posix_msg_tree_node *leaf;
 	bool rightmost = true;
 
+	/*
+	 * Most queues carry messages of one or a few priorities, usually
+	 * sent at the highest priority currently queued.  Check the
+	 * rightmost node first, so that such inserts skip the tree walk.
+	 */
+	if (info->msg_tree_rightmost) {
+		parent = info->msg_tree_rightmost;
+		leaf = rb_entry(parent, struct posix_msg_tree_node, rb_node);
+		if (leaf->priority == msg->m_type)
+			goto insert_msg;
+		if (msg->m_type > leaf->priority) {
+			p = &parent->rb_right;
+			goto new_leaf;
+		}
+		parent = NULL;
+	}
+
 	p = &info->msg_tree.rb_node;
 	while (*p) {
 		parent = *p;
@@ -208,6 +225,7 @@ static int msg_insert(struct msg_msg *msg, struct mqueue_inode_info *info)
 		} else
 			p = &(*p)->rb_right;
 	}
+new_leaf:
 	if (info->node_cache) {
 		leaf = info->node_cache;
 		info->node_cache = NULL;
@@ -1009,6 +1009,25 @@ static void set_semotime(struct sem_array *sma, struct sembuf *sops)
 	}
 }
 
+/**
+ * sem_has_waiters - check whether anybody waits on a semaphore
+ * @sma: semaphore array
+ * @semnum: semaphore that was modified
+ *
+ * Returns true if an update of semaphore @semnum might complete a sleeping
+ * operation, either one queued on the semaphore itself or a complex
+ * operation on the global queues.
+ */
+static inline bool sem_has_waiters(struct sem_array *sma, int semnum)
+{
+	struct sem *curr = &sma->sems[semnum];
+
+	return !list_empty(&curr->pending_alter) ||
+	       !list_empty(&curr->pending_const) ||
+	       !list_empty(&sma->pending_alter) ||
+	       !list_empty(&sma->pending_const);
+}
+
 /**
  * do_smart_update - optimized update_queue
  * @sma: semaphore array
@@ -1028,6 +1047,17 @@ static void do_smart_update(struct sem_array *sma, struct sembuf *sops, int nsop
 {
 	int i;
 
+	/*
+	 * Fast path for the common case of a single operation on a
+	 * semaphore nobody sleeps on, e.g. an uncontended semaphore used
+	 * as a mutex: there is nothing to wake up, skip the queue scans.
+	 */
+	if (sops && nsops == 1 && !sem_has_waiters(sma, sops[0].sem_num)) {
+		if (otime)
+			set_semotime(sma, sops);
+		return;
+	}
+
 	otime |= do_smart_wakeup_zero(sma, sops, nsops, wake_q);
 
 	if (!list_empty(&sma->pending_alter)) {
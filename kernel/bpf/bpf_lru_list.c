@@ -13,6 +13,8 @@
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
+#define CLOCK_NR_SCANS			(32)
+
 /* Helpers to get the local list index */
 #define LOCAL_LIST_IDX(t)	((t) - BPF_LOCAL_LIST_T_OFFSET)
 #define LOCAL_FREE_LIST_IDX	LOCAL_LIST_IDX(BPF_LRU_LOCAL_LIST_T_FREE)
@@ -491,9 +493,153 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+/* The clock LRU keeps a ring of in use nodes and a free list per CPU.
+ * Lookups only set the ref bit of a node, without taking any lock.
+ * Eviction walks the ring from its oldest node and gives a referenced
+ * node a second chance by clearing its ref bit and moving it to the
+ * end of the ring.
+ *
+ * Unlike the percpu LRU, the capacity of the map is not split between
+ * the CPUs: the free nodes of the other CPUs are used up before a CPU
+ * evicts from its ring, and a CPU with an empty ring evicts from the
+ * other CPUs' rings. A count of the free nodes of all CPUs lets a full
+ * map skip looking for them.
+ */
+static struct bpf_lru_node *__bpf_clock_lru_pop_free(struct bpf_lru *lru,
+						     struct bpf_clock_lru *cl)
+{
+	struct bpf_lru_node *node;
+
+	node = list_first_entry_or_null(&cl->free, struct bpf_lru_node, list);
+	if (node) {
+		list_del(&node->list);
+		atomic_dec(&lru->nr_free);
+	}
+
+	return node;
+}
+
+static struct bpf_lru_node *__bpf_clock_lru_evict(struct bpf_lru *lru,
+						  struct bpf_clock_lru *cl)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	unsigned int i = 0;
+
+	list_for_each_entry_safe(node, tmp_node, &cl->ring, list) {
+		if (i++ == lru->nr_scans)
+			break;
+
+		if (bpf_lru_node_is_ref(node)) {
+			node->ref = 0;
+			list_move_tail(&node->list, &cl->ring);
+		} else if (lru->del_from_htab(lru->del_arg, node)) {
+			list_del(&node->list);
+			return node;
+		}
+	}
+
+	/* Everything scanned was referenced, ignore the ref bit. */
+	list_for_each_entry(node, &cl->ring, list) {
+		if (lru->del_from_htab(lru->del_arg, node)) {
+			list_del(&node->list);
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+static void __bpf_clock_lru_add(struct bpf_lru *lru, struct bpf_clock_lru *cl,
+				int cpu, struct bpf_lru_node *node, u32 hash)
+{
+	*(u32 *)((void *)node + lru->hash_offset) = hash;
+	node->cpu = cpu;
+	node->type = BPF_LRU_LIST_T_ACTIVE;
+	node->ref = 0;
+	list_add_tail(&node->list, &cl->ring);
+}
+
+static struct bpf_lru_node *bpf_clock_lru_steal(struct bpf_lru *lru,
+						struct bpf_clock_lru *cl,
+						bool evict)
+{
+	struct bpf_clock_lru *steal_cl;
+	struct bpf_lru_node *node = NULL;
+	int steal, first_steal;
+	unsigned long flags;
+
+	first_steal = cl->next_steal;
+	steal = first_steal;
+	do {
+		steal_cl = per_cpu_ptr(lru->clock_lru, steal);
+
+		/* The free list is checked again under the lock */
+		if (evict || !list_empty(&steal_cl->free)) {
+			raw_spin_lock_irqsave(&steal_cl->lock, flags);
+
+			if (evict)
+				node = __bpf_clock_lru_evict(lru, steal_cl);
+			else
+				node = __bpf_clock_lru_pop_free(lru, steal_cl);
+
+			raw_spin_unlock_irqrestore(&steal_cl->lock, flags);
+		}
+
+		steal = get_next_cpu(steal);
+	} while (!node && steal != first_steal);
+
+	cl->next_steal = steal;
+
+	return node;
+}
+
+static struct bpf_lru_node *bpf_clock_lru_pop_free(struct bpf_lru *lru,
+						   u32 hash)
+{
+	struct bpf_clock_lru *cl;
+	struct bpf_lru_node *node;
+	unsigned long flags;
+	int cpu = raw_smp_processor_id();
+
+	cl = per_cpu_ptr(lru->clock_lru, cpu);
+
+	raw_spin_lock_irqsave(&cl->lock, flags);
+	node = __bpf_clock_lru_pop_free(lru, cl);
+	if (node)
+		__bpf_clock_lru_add(lru, cl, cpu, node, hash);
+	raw_spin_unlock_irqrestore(&cl->lock, flags);
+
+	if (node)
+		return node;
+
+	if (atomic_read(&lru->nr_free))
+		node = bpf_clock_lru_steal(lru, cl, false);
+
+	raw_spin_lock_irqsave(&cl->lock, flags);
+	if (!node)
+		node = __bpf_clock_lru_evict(lru, cl);
+	if (node)
+		__bpf_clock_lru_add(lru, cl, cpu, node, hash);
+	raw_spin_unlock_irqrestore(&cl->lock, flags);
+
+	if (node)
+		return node;
+
+	node = bpf_clock_lru_steal(lru, cl, true);
+	if (node) {
+		raw_spin_lock_irqsave(&cl->lock, flags);
+		__bpf_clock_lru_add(lru, cl, cpu, node, hash);
+		raw_spin_unlock_irqrestore(&cl->lock, flags);
+	}
+
+	return node;
+}
+
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		return bpf_clock_lru_pop_free(lru, hash);
+	else if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
@@ -547,9 +693,32 @@ static void bpf_percpu_lru_push_free(struct bpf_lru *lru,
 	raw_spin_unlock_irqrestore(&l->lock, flags);
 }
 
+static void bpf_clock_lru_push_free(struct bpf_lru *lru,
+				    struct bpf_lru_node *node)
+{
+	struct bpf_clock_lru *cl;
+	unsigned long flags;
+
+	if (WARN_ON_ONCE(node->type == BPF_LRU_LIST_T_FREE))
+		return;
+
+	cl = per_cpu_ptr(lru->clock_lru, node->cpu);
+
+	raw_spin_lock_irqsave(&cl->lock, flags);
+
+	node->type = BPF_LRU_LIST_T_FREE;
+	node->ref = 0;
+	list_move(&node->list, &cl->free);
+	atomic_inc(&lru->nr_free);
+
+	raw_spin_unlock_irqrestore(&cl->lock, flags);
+}
+
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		bpf_clock_lru_push_free(lru, node);
+	else if (lru->percpu)
 		bpf_percpu_lru_push_free(lru, node);
 	else
 		bpf_common_lru_push_free(lru, node);
@@ -604,10 +773,42 @@ static void bpf_percpu_lru_populate(struct bpf_lru *lru, void *buf,
 	}
 }
 
+static void bpf_clock_lru_populate(struct bpf_lru *lru, void *buf,
+				   u32 node_offset, u32 elem_size,
+				   u32 nr_elems)
+{
+	struct bpf_clock_lru *cl = NULL;
+	u32 i, pcpu_entries;
+	int cpu = -1;
+
+	pcpu_entries = DIV_ROUND_UP(nr_elems, num_possible_cpus());
+
+	for (i = 0; i < nr_elems; i++) {
+		struct bpf_lru_node *node;
+
+		if (!(i % pcpu_entries)) {
+			cpu = cpumask_next(cpu, cpu_possible_mask);
+			cl = per_cpu_ptr(lru->clock_lru, cpu);
+		}
+
+		node = (struct bpf_lru_node *)(buf + node_offset);
+		node->cpu = cpu;
+		node->type = BPF_LRU_LIST_T_FREE;
+		node->ref = 0;
+		list_add(&node->list, &cl->free);
+		buf += elem_size;
+	}
+
+	atomic_add(nr_elems, &lru->nr_free);
+}
+
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		bpf_clock_lru_populate(lru, buf, node_offset, elem_size,
+				       nr_elems);
+	else if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
 	else
@@ -642,12 +843,31 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *del_arg)
+static void bpf_clock_lru_init(struct bpf_clock_lru *cl, int cpu)
+{
+	INIT_LIST_HEAD(&cl->ring);
+	INIT_LIST_HEAD(&cl->free);
+	cl->next_steal = cpu;
+	raw_spin_lock_init(&cl->lock);
+}
+
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *del_arg)
 {
 	int cpu;
 
-	if (percpu) {
+	if (clock) {
+		lru->clock_lru = alloc_percpu(struct bpf_clock_lru);
+		if (!lru->clock_lru)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu)
+			bpf_clock_lru_init(per_cpu_ptr(lru->clock_lru, cpu),
+					   cpu);
+		lru->nr_scans = CLOCK_NR_SCANS;
+		atomic_set(&lru->nr_free, 0);
+	} else if (percpu) {
 		lru->percpu_lru = alloc_percpu(struct bpf_lru_list);
 		if (!lru->percpu_lru)
 			return -ENOMEM;
@@ -678,6 +898,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->clock = clock;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
@@ -687,7 +908,9 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 
 void bpf_lru_destroy(struct bpf_lru *lru)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		free_percpu(lru->clock_lru);
+	else if (lru->percpu)
 		free_percpu(lru->percpu_lru);
 	else
 		free_percpu(lru->common_lru.local_list);
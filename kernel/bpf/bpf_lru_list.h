@@ -47,18 +47,29 @@ struct bpf_common_lru {
 	struct bpf_lru_locallist __percpu *local_list;
 };
 
+struct bpf_clock_lru {
+	/* In use nodes, the oldest one first */
+	struct list_head ring;
+	struct list_head free;
+	u16 next_steal;
+	raw_spinlock_t lock;
+};
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
 	union {
 		struct bpf_common_lru common_lru;
 		struct bpf_lru_list __percpu *percpu_lru;
+		struct bpf_clock_lru __percpu *clock_lru;
 	};
 	del_from_htab_func del_from_htab;
 	void *del_arg;
 	unsigned int hash_offset;
 	unsigned int nr_scans;
+	atomic_t nr_free;	/* free nodes of all CPUs, clock LRU only */
 	bool percpu;
+	bool clock;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -70,8 +81,9 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		node->ref = 1;
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *delete_arg);
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
 void bpf_lru_destroy(struct bpf_lru *lru);
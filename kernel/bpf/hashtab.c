@@ -15,7 +15,7 @@
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_LRU_CLOCK)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -278,6 +278,7 @@ static int prealloc_init(struct bpf_htab *htab)
 	if (htab_is_lru(htab))
 		err = bpf_lru_init(&htab->lru,
 				   htab->map.map_flags & BPF_F_NO_COMMON_LRU,
+				   htab->map.map_flags & BPF_F_LRU_CLOCK,
 				   offsetof(struct htab_elem, hash) -
 				   offsetof(struct htab_elem, lru_node),
 				   htab_lru_map_delete_node,
@@ -350,6 +351,10 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	 * nothing to do with the map's value.
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
+	/* clock_lru keeps per cpu lists like percpu_lru, but the capacity
+	 * of the map is shared by all cpus.
+	 */
+	bool clock_lru = (attr->map_flags & BPF_F_LRU_CLOCK);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
 	int numa_node = bpf_map_attr_numa_node(attr);
@@ -373,7 +378,10 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	    !bpf_map_flags_access_ok(attr->map_flags))
 		return -EINVAL;
 
-	if (!lru && percpu_lru)
+	if (!lru && (percpu_lru || clock_lru))
+		return -EINVAL;
+
+	if (percpu_lru && clock_lru)
 		return -EINVAL;
 
 	if (lru && !prealloc)
@@ -28,12 +28,24 @@ struct lpm_trie_node {
 	u8				data[];
 };
 
+/* Multibit index node, see below */
+#define LPM_MB_STRIDE	6
+
+struct lpm_mb_node {
+	struct rcu_head rcu;
+	u64				external;
+	u64				internal;
+	void __rcu			*slot[];
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
+	struct lpm_mb_node __rcu	*mb_root;
 	size_t				n_entries;
 	size_t				max_prefixlen;
 	size_t				data_size;
+	bool				multibit;
 	spinlock_t			lock;
 };
 
@@ -223,6 +235,319 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
+/* With BPF_F_LPM_MULTIBIT, lookups do not walk the binary trie but a
+ * multibit index of it. The binary trie stays the authoritative copy that
+ * updates, deletes and get_next_key work on, and the index only points to
+ * its non-intermediate nodes, so the values are not stored twice.
+ *
+ * Each index node covers LPM_MB_STRIDE bits of the key, in the style of a
+ * tree bitmap. For the bits at offset off, it has
+ *
+ * - an external bitmap with one bit for each of the 2^LPM_MB_STRIDE values
+ *   of those bits, set when there is a child node for the following bits,
+ * - an internal bitmap with one bit for each prefix of length off + l,
+ *   0 <= l < LPM_MB_STRIDE, the prefix of length l and value v using bit
+ *   2^l - 1 + v. A longer prefix thus always uses a higher bit.
+ *
+ * @slot holds the children followed by the trie nodes, both in the order of
+ * their bits, so the slot of a bit is found by counting the lower bits set.
+ * For an IPv4 key a lookup visits at most 6 index nodes, rather than up to
+ * 32 trie nodes.
+ *
+ * Index nodes are never changed in place, except for replacing a slot. A
+ * node which gains or loses a bit is copied and the copy is published in
+ * the slot of the old node. The slot of a trie node which could not be
+ * removed for lack of memory is set to NULL and skipped by lookups.
+ */
+static u32 lpm_mb_chunk(const struct lpm_trie *trie, const u8 *data, u32 off)
+{
+	u32 i = off / 8, v;
+
+	if (off >= trie->max_prefixlen)
+		return 0;
+
+	v = data[i] << 8;
+	if (i + 1 < trie->data_size)
+		v |= data[i + 1];
+
+	return (v >> (16 - LPM_MB_STRIDE - off % 8)) &
+	       (BIT(LPM_MB_STRIDE) - 1);
+}
+
+static u64 lpm_mb_prefix_bit(u32 chunk, u32 len)
+{
+	return BIT_ULL(BIT(len) - 1 + (chunk >> (LPM_MB_STRIDE - len)));
+}
+
+static void __rcu **lpm_mb_child_slot(struct lpm_mb_node *node, u32 chunk)
+{
+	return &node->slot[hweight64(node->external &
+				     (BIT_ULL(chunk) - 1))];
+}
+
+static void __rcu **lpm_mb_leaf_slot(struct lpm_mb_node *node, u64 bit)
+{
+	return &node->slot[hweight64(node->external) +
+			   hweight64(node->internal & (bit - 1))];
+}
+
+static struct lpm_trie_node *lpm_mb_lookup(const struct lpm_trie *trie,
+					   const struct bpf_lpm_trie_key *key)
+{
+	struct lpm_trie_node *found = NULL, *leaf;
+	struct lpm_mb_node *node;
+	u32 off, len, chunk;
+	u64 match;
+
+	for (node = rcu_dereference(trie->mb_root), off = 0; node;
+	     off += LPM_MB_STRIDE) {
+		chunk = lpm_mb_chunk(trie, key->data, off);
+
+		/* All prefixes in this node which match @key */
+		match = 0;
+		for (len = 0; len < LPM_MB_STRIDE; len++) {
+			if (off + len > key->prefixlen)
+				break;
+			match |= lpm_mb_prefix_bit(chunk, len);
+		}
+		match &= node->internal;
+
+		while (match) {
+			u64 bit = BIT_ULL(fls64(match) - 1);
+
+			leaf = rcu_dereference(*lpm_mb_leaf_slot(node, bit));
+			if (leaf) {
+				found = leaf;
+				break;
+			}
+			match &= ~bit;
+		}
+
+		if (off + LPM_MB_STRIDE > key->prefixlen ||
+		    !(node->external & BIT_ULL(chunk)))
+			break;
+
+		node = rcu_dereference(*lpm_mb_child_slot(node, chunk));
+	}
+
+	return found;
+}
+
+/* Allocate a copy of @old, which may be NULL, with the given bitmaps. They
+ * differ from the ones of @old in at most one bit, the slot of an added bit
+ * is set to @ptr.
+ */
+static struct lpm_mb_node *lpm_mb_node_alloc(const struct lpm_trie *trie,
+					     struct lpm_mb_node *old,
+					     u64 external, u64 internal,
+					     void *ptr)
+{
+	u64 old_external = old ? old->external : 0;
+	u64 old_internal = old ? old->internal : 0;
+	struct lpm_mb_node *node;
+	unsigned int i = 0, j = 0;
+	u64 bits, bit;
+	void *p;
+
+	node = kmalloc_node(struct_size(node, slot, hweight64(external) +
+					hweight64(internal)),
+			    GFP_ATOMIC | __GFP_NOWARN, trie->map.numa_node);
+	if (!node)
+		return NULL;
+
+	node->external = external;
+	node->internal = internal;
+
+	for (bits = external | old_external; bits; bits &= bits - 1) {
+		bit = bits & -bits;
+		p = old_external & bit ? rcu_access_pointer(old->slot[i++]) :
+		    ptr;
+		if (external & bit)
+			RCU_INIT_POINTER(node->slot[j++], p);
+	}
+
+	for (bits = internal | old_internal; bits; bits &= bits - 1) {
+		bit = bits & -bits;
+		p = old_internal & bit ? rcu_access_pointer(old->slot[i++]) :
+		    ptr;
+		if (internal & bit)
+			RCU_INIT_POINTER(node->slot[j++], p);
+	}
+
+	return node;
+}
+
+/* Add @leaf to the index, or replace the trie node with the same prefix */
+static int lpm_mb_insert(struct lpm_trie *trie, struct lpm_trie_node *leaf)
+{
+	void __rcu **slot = (void __rcu **)&trie->mb_root;
+	u32 plen = leaf->prefixlen, off = 0, o;
+	struct lpm_mb_node *node, *new_node;
+	u64 external = 0, internal;
+	void *ptr = leaf;
+
+	while ((node = rcu_dereference_protected(*slot,
+					lockdep_is_held(&trie->lock))) &&
+	       plen - off >= LPM_MB_STRIDE) {
+		u32 chunk = lpm_mb_chunk(trie, leaf->data, off);
+
+		if (!(node->external & BIT_ULL(chunk)))
+			break;
+
+		slot = lpm_mb_child_slot(node, chunk);
+		off += LPM_MB_STRIDE;
+	}
+
+	o = plen - plen % LPM_MB_STRIDE;
+	internal = lpm_mb_prefix_bit(lpm_mb_chunk(trie, leaf->data, o),
+				     plen - o);
+
+	if (node && o == off && (node->internal & internal)) {
+		rcu_assign_pointer(*lpm_mb_leaf_slot(node, internal), leaf);
+		return 0;
+	}
+
+	/* Build the missing part of the path bottom up, the top of it is a
+	 * copy of @node if there is one.
+	 */
+	for (;;) {
+		struct lpm_mb_node *base = o == off ? node : NULL;
+
+		new_node = lpm_mb_node_alloc(trie, base,
+					     (base ? base->external : 0) |
+					     external,
+					     (base ? base->internal : 0) |
+					     internal, ptr);
+		if (!new_node)
+			goto free_path;
+		if (o == off)
+			break;
+
+		ptr = new_node;
+		o -= LPM_MB_STRIDE;
+		external = BIT_ULL(lpm_mb_chunk(trie, leaf->data, o));
+		internal = 0;
+	}
+
+	rcu_assign_pointer(*slot, new_node);
+	if (node)
+		kfree_rcu(node, rcu);
+
+	return 0;
+
+free_path:
+	while (ptr != leaf) {
+		new_node = ptr;
+		ptr = rcu_access_pointer(new_node->slot[0]);
+		kfree(new_node);
+	}
+
+	return -ENOMEM;
+}
+
+/* Remove @leaf from the index, along with the nodes this leaves empty */
+static void lpm_mb_delete(struct lpm_trie *trie, struct lpm_trie_node *leaf)
+{
+	void __rcu **slot = (void __rcu **)&trie->mb_root, **keep_slot = slot;
+	struct lpm_mb_node *node, *keep = NULL, *new_node;
+	u32 plen = leaf->prefixlen, off = 0, chunk;
+	u64 keep_bit = 0, bit;
+
+	for (;;) {
+		node = rcu_dereference_protected(*slot,
+						 lockdep_is_held(&trie->lock));
+		if (WARN_ON_ONCE(!node))
+			return;
+
+		chunk = lpm_mb_chunk(trie, leaf->data, off);
+		if (plen - off < LPM_MB_STRIDE)
+			break;
+
+		/* The deepest node which does not become empty */
+		if (hweight64(node->external) + hweight64(node->internal) > 1) {
+			keep = node;
+			keep_slot = slot;
+			keep_bit = BIT_ULL(chunk);
+		}
+
+		if (WARN_ON_ONCE(!(node->external & BIT_ULL(chunk))))
+			return;
+		slot = lpm_mb_child_slot(node, chunk);
+		off += LPM_MB_STRIDE;
+	}
+
+	bit = lpm_mb_prefix_bit(chunk, plen - off);
+	if (WARN_ON_ONCE(!(node->internal & bit)))
+		return;
+
+	if (hweight64(node->external) + hweight64(node->internal) > 1) {
+		keep = node;
+		keep_slot = slot;
+		keep_bit = 0;
+	}
+
+	if (keep) {
+		new_node = lpm_mb_node_alloc(trie, keep,
+					     keep->external & ~keep_bit,
+					     keep_bit ? keep->internal :
+					     keep->internal & ~bit, NULL);
+		if (!new_node) {
+			RCU_INIT_POINTER(*lpm_mb_leaf_slot(node, bit), NULL);
+			return;
+		}
+		node = keep_bit ?
+		       rcu_access_pointer(*lpm_mb_child_slot(keep,
+						__ffs64(keep_bit))) : NULL;
+		rcu_assign_pointer(*keep_slot, new_node);
+		kfree_rcu(keep, rcu);
+	} else {
+		node = rcu_access_pointer(*keep_slot);
+		RCU_INIT_POINTER(*keep_slot, NULL);
+	}
+
+	/* Free the nodes below @keep, each has a single slot */
+	while (node) {
+		new_node = node;
+		node = node->external ? rcu_access_pointer(node->slot[0]) :
+		       NULL;
+		kfree_rcu(new_node, rcu);
+	}
+}
+
+static void lpm_mb_free(struct lpm_trie *trie)
+{
+	struct lpm_mb_node *node, *parent;
+	void __rcu **slot;
+	u64 last;
+
+	/* Like trie_free(), free a node without children and start over */
+	for (;;) {
+		slot = (void __rcu **)&trie->mb_root;
+		parent = NULL;
+
+		for (;;) {
+			node = rcu_dereference_protected(*slot, 1);
+			if (!node)
+				return;
+
+			/* The last child has the highest external bit */
+			if (node->external) {
+				parent = node;
+				last = BIT_ULL(fls64(node->external) - 1);
+				slot = lpm_mb_child_slot(node, fls64(last) - 1);
+				continue;
+			}
+
+			kfree(node);
+			if (parent)
+				parent->external &= ~last;
+			else
+				RCU_INIT_POINTER(*slot, NULL);
+			break;
+		}
+	}
+}
+
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
@@ -230,6 +555,11 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 	struct lpm_trie_node *node, *found = NULL;
 	struct bpf_lpm_trie_key *key = _key;
 
+	if (trie->multibit) {
+		found = lpm_mb_lookup(trie, key);
+		goto out;
+	}
+
 	/* Start walking the trie from the root node ... */
 
 	for (node = rcu_dereference(trie->root); node;) {
@@ -267,6 +597,7 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 		node = rcu_dereference(node->child[next_bit]);
 	}
 
+out:
 	if (!found)
 		return NULL;
 
@@ -357,6 +688,22 @@ static int trie_update_elem(struct bpf_map *map,
 		slot = &node->child[next_bit];
 	}
 
+	/* Do everything that can fail before @new_node is linked */
+	if (node && node->prefixlen != matchlen &&
+	    matchlen != key->prefixlen) {
+		im_node = lpm_trie_node_alloc(trie, NULL);
+		if (!im_node) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (trie->multibit) {
+		ret = lpm_mb_insert(trie, new_node);
+		if (ret)
+			goto out;
+	}
+
 	/* If the slot is empty (a free child pointer or an empty root),
 	 * simply assign the @new_node to that slot and be done.
 	 */
@@ -391,12 +738,6 @@ static int trie_update_elem(struct bpf_map *map,
 		goto out;
 	}
 
-	im_node = lpm_trie_node_alloc(trie, NULL);
-	if (!im_node) {
-		ret = -ENOMEM;
-		goto out;
-	}
-
 	im_node->prefixlen = matchlen;
 	im_node->flags |= LPM_TREE_NODE_FLAG_IM;
 	memcpy(im_node->data, node->data, trie->data_size);
@@ -474,6 +815,9 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 		goto out;
 	}
 
+	if (trie->multibit)
+		lpm_mb_delete(trie, node);
+
 	trie->n_entries--;
 
 	/* If the node we are removing has two children, simply mark it
@@ -535,7 +879,7 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 #define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
 
 #define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
-				 BPF_F_ACCESS_MASK)
+				 BPF_F_ACCESS_MASK | BPF_F_LPM_MULTIBIT)
 
 static struct bpf_map *trie_alloc(union bpf_attr *attr)
 {
@@ -566,9 +910,14 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 	trie->data_size = attr->key_size -
 			  offsetof(struct bpf_lpm_trie_key, data);
 	trie->max_prefixlen = trie->data_size * 8;
+	trie->multibit = attr->map_flags & BPF_F_LPM_MULTIBIT;
 
 	cost_per_node = sizeof(struct lpm_trie_node) +
 			attr->value_size + trie->data_size;
+	/* Roughly, index nodes are shared by the prefixes below them */
+	if (trie->multibit)
+		cost_per_node += sizeof(struct lpm_mb_node) +
+				 2 * sizeof(void *);
 	cost += (u64) attr->max_entries * cost_per_node;
 
 	ret = bpf_map_charge_init(&trie->map.memory, cost);
@@ -624,6 +973,7 @@ static void trie_free(struct bpf_map *map)
 	}
 
 out:
+	lpm_mb_free(trie);
 	kfree(trie);
 }
 
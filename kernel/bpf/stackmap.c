@@ -13,7 +13,10 @@
 
 #define STACK_CREATE_FLAG_MASK					\
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY |	\
-	 BPF_F_STACK_BUILD_ID)
+	 BPF_F_STACK_BUILD_ID | BPF_F_STACK_DEDUP)
+
+/* Frames per stack id the frame pool of a BPF_F_STACK_DEDUP map has */
+#define STACK_DEDUP_FRAMES_PER_STACK	8
 
 struct stack_map_bucket {
 	struct pcpu_freelist_node fnode;
@@ -22,10 +25,39 @@ struct stack_map_bucket {
 	u64 data[];
 };
 
+/* With BPF_F_STACK_DEDUP, a stack is a chain of frames from its innermost
+ * frame out to its outermost caller. Frames are hash-consed on (caller
+ * frame, ip), so all stacks with the same callers share the frames for
+ * them and a stack only takes as much room as the frames it does not have
+ * in common with any other stack.
+ *
+ * Frames are referenced by their index in @frames, 0 being none, and
+ * counted by the stacks and frames pointing to them. All of it is
+ * protected by @lock.
+ */
+struct stack_map_frame {
+	u64 ip;
+	u32 parent;	/* caller frame */
+	u32 next;	/* next frame in the hash chain or the free list */
+	u32 refcnt;
+};
+
+struct stack_map_dedup_stack {
+	u32 hash;
+	u32 nr;
+	u32 leaf;	/* innermost frame, 0 for an unused id */
+};
+
 struct bpf_stack_map {
 	struct bpf_map map;
 	void *elems;
 	struct pcpu_freelist freelist;
+	struct stack_map_frame *frames;
+	struct stack_map_dedup_stack *stacks;
+	u32 *frame_heads;
+	u32 n_frame_buckets;
+	u32 frame_free;
+	raw_spinlock_t lock;
 	u32 n_buckets;
 	struct stack_map_bucket *buckets[];
 };
@@ -50,17 +82,251 @@ static void do_up_read(struct irq_work *entry)
 
 static DEFINE_PER_CPU(struct stack_map_irq_work, up_read_work);
 
+/* Set while this CPU takes or holds the lock of a BPF_F_STACK_DEDUP map */
+static DEFINE_PER_CPU(int, stack_map_dedup_busy);
+
 static inline bool stack_map_use_build_id(struct bpf_map *map)
 {
 	return (map->map_flags & BPF_F_STACK_BUILD_ID);
 }
 
+static inline bool stack_map_use_dedup(struct bpf_map *map)
+{
+	return (map->map_flags & BPF_F_STACK_DEDUP);
+}
+
 static inline int stack_map_data_size(struct bpf_map *map)
 {
 	return stack_map_use_build_id(map) ?
 		sizeof(struct bpf_stack_build_id) : sizeof(u64);
 }
 
+static void stack_map_dedup_init(struct bpf_stack_map *smap, u32 n_frames,
+				 u32 n_frame_buckets)
+{
+	u32 i;
+
+	/* The arrays follow the (empty) buckets, frames first for alignment */
+	smap->frames = (void *)smap + sizeof(*smap);
+	smap->stacks = (void *)(smap->frames + n_frames + 1);
+	smap->frame_heads = (void *)(smap->stacks + smap->n_buckets);
+	smap->n_frame_buckets = n_frame_buckets;
+
+	for (i = 1; i < n_frames; i++)
+		smap->frames[i].next = i + 1;
+	smap->frame_free = 1;
+
+	raw_spin_lock_init(&smap->lock);
+}
+
+/* An NMI which interrupted this CPU while it takes or holds the lock must
+ * not wait for it, so it fails with -EBUSY then. A holder on another CPU
+ * always releases the lock, so an NMI waits for it like anyone else.
+ */
+static bool stack_map_dedup_lock(struct bpf_stack_map *smap,
+				 unsigned long *flags)
+{
+	local_irq_save(*flags);
+	if (in_nmi() && __this_cpu_read(stack_map_dedup_busy)) {
+		local_irq_restore(*flags);
+		return false;
+	}
+
+	__this_cpu_inc(stack_map_dedup_busy);
+	raw_spin_lock(&smap->lock);
+	return true;
+}
+
+static void stack_map_dedup_unlock(struct bpf_stack_map *smap,
+				   unsigned long flags)
+{
+	raw_spin_unlock(&smap->lock);
+	__this_cpu_dec(stack_map_dedup_busy);
+	local_irq_restore(flags);
+}
+
+static u32 *stack_map_frame_head(struct bpf_stack_map *smap, u32 parent,
+				 u64 ip)
+{
+	u32 hash = jhash_3words((u32)ip, ip >> 32, parent, 0);
+
+	return &smap->frame_heads[hash & (smap->n_frame_buckets - 1)];
+}
+
+/* Find the frame for @ip called from frame @parent, or add it. A new frame
+ * has no reference yet. Returns 0 when the frame pool is exhausted.
+ */
+static u32 stack_map_frame_get(struct bpf_stack_map *smap, u32 parent, u64 ip)
+{
+	u32 *head = stack_map_frame_head(smap, parent, ip);
+	struct stack_map_frame *frame;
+	u32 idx;
+
+	for (idx = *head; idx; idx = frame->next) {
+		frame = &smap->frames[idx];
+		if (frame->ip == ip && frame->parent == parent)
+			return idx;
+	}
+
+	idx = smap->frame_free;
+	if (!idx)
+		return 0;
+
+	frame = &smap->frames[idx];
+	smap->frame_free = frame->next;
+
+	frame->ip = ip;
+	frame->parent = parent;
+	frame->refcnt = 0;
+	frame->next = *head;
+	*head = idx;
+
+	if (parent)
+		smap->frames[parent].refcnt++;
+
+	return idx;
+}
+
+/* Drop a reference to frame @idx, and free the frames no longer used */
+static void stack_map_frame_put(struct bpf_stack_map *smap, u32 idx)
+{
+	struct stack_map_frame *frame;
+	u32 *pnext;
+
+	while (idx) {
+		frame = &smap->frames[idx];
+		if (--frame->refcnt)
+			return;
+
+		pnext = stack_map_frame_head(smap, frame->parent, frame->ip);
+		while (*pnext != idx)
+			pnext = &smap->frames[*pnext].next;
+		*pnext = frame->next;
+
+		frame->next = smap->frame_free;
+		smap->frame_free = idx;
+
+		idx = frame->parent;
+	}
+}
+
+static bool stack_map_dedup_equal(struct bpf_stack_map *smap,
+				  const struct stack_map_dedup_stack *stack,
+				  const u64 *ips, u32 nr)
+{
+	u32 idx = stack->leaf, i;
+
+	if (stack->nr != nr)
+		return false;
+
+	for (i = 0; i < nr; i++, idx = smap->frames[idx].parent) {
+		if (smap->frames[idx].ip != ips[i])
+			return false;
+	}
+
+	return true;
+}
+
+static long stack_map_dedup_get_stackid(struct bpf_stack_map *smap,
+					u64 *ips, u32 nr, u32 hash, u32 id,
+					u64 flags)
+{
+	struct stack_map_dedup_stack *stack = &smap->stacks[id];
+	u32 leaf = 0, frame, old, i;
+	unsigned long irq_flags;
+	long ret = id;
+
+	if (!stack_map_dedup_lock(smap, &irq_flags))
+		return -EBUSY;
+
+	if (stack->leaf && stack->hash == hash &&
+	    (flags & BPF_F_FAST_STACK_CMP ||
+	     stack_map_dedup_equal(smap, stack, ips, nr)))
+		goto out;
+
+	if (stack->leaf && !(flags & BPF_F_REUSE_STACKID)) {
+		ret = -EEXIST;
+		goto out;
+	}
+
+	/* Outermost caller first, that is the end stacks have in common */
+	for (i = nr; i > 0; i--) {
+		frame = stack_map_frame_get(smap, leaf, ips[i - 1]);
+		if (!frame)
+			break;
+		leaf = frame;
+	}
+
+	if (leaf)
+		smap->frames[leaf].refcnt++;
+
+	if (i) {
+		/* Free the frames added for this stack again */
+		stack_map_frame_put(smap, leaf);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	old = stack->leaf;
+	stack->hash = hash;
+	stack->nr = nr;
+	stack->leaf = leaf;
+	stack_map_frame_put(smap, old);
+
+out:
+	stack_map_dedup_unlock(smap, irq_flags);
+	return ret;
+}
+
+static int stack_map_dedup_copy(struct bpf_stack_map *smap, u32 id,
+				void *value)
+{
+	struct stack_map_dedup_stack *stack = &smap->stacks[id];
+	unsigned long irq_flags;
+	u64 *ips = value;
+	u32 idx, nr = 0;
+
+	if (!stack_map_dedup_lock(smap, &irq_flags))
+		return -EBUSY;
+
+	for (idx = stack->leaf; idx; idx = smap->frames[idx].parent)
+		ips[nr++] = smap->frames[idx].ip;
+
+	stack_map_dedup_unlock(smap, irq_flags);
+
+	if (!nr)
+		return -ENOENT;
+
+	memset(ips + nr, 0, smap->map.value_size - nr * sizeof(u64));
+	return 0;
+}
+
+static int stack_map_dedup_delete(struct bpf_stack_map *smap, u32 id)
+{
+	struct stack_map_dedup_stack *stack = &smap->stacks[id];
+	unsigned long irq_flags;
+	u32 old;
+
+	if (!stack_map_dedup_lock(smap, &irq_flags))
+		return -EBUSY;
+
+	old = stack->leaf;
+	stack->leaf = 0;
+	stack_map_frame_put(smap, old);
+
+	stack_map_dedup_unlock(smap, irq_flags);
+
+	return old ? 0 : -ENOENT;
+}
+
+static bool stack_map_id_used(struct bpf_stack_map *smap, u32 id)
+{
+	if (stack_map_use_dedup(&smap->map))
+		return READ_ONCE(smap->stacks[id].leaf);
+
+	return smap->buckets[id];
+}
+
 static int prealloc_elems_and_freelist(struct bpf_stack_map *smap)
 {
 	u32 elem_size = sizeof(struct stack_map_bucket) + smap->map.value_size;
@@ -87,10 +353,11 @@ static int prealloc_elems_and_freelist(struct bpf_stack_map *smap)
 /* Called from syscall */
 static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 {
+	bool dedup = attr->map_flags & BPF_F_STACK_DEDUP;
+	u64 cost, n_buckets, n_frames = 0, n_frame_buckets = 0;
 	u32 value_size = attr->value_size;
 	struct bpf_stack_map *smap;
 	struct bpf_map_memory mem;
-	u64 cost, n_buckets;
 	int err;
 
 	if (!capable(CAP_SYS_ADMIN))
@@ -113,11 +380,31 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	} else if (value_size / 8 > sysctl_perf_event_max_stack)
 		return ERR_PTR(-EINVAL);
 
+	if (dedup && (attr->map_flags & BPF_F_STACK_BUILD_ID))
+		return ERR_PTR(-EINVAL);
+
 	/* hash table size must be power of 2 */
 	n_buckets = roundup_pow_of_two(attr->max_entries);
 
-	cost = n_buckets * sizeof(struct stack_map_bucket *) + sizeof(*smap);
-	cost += n_buckets * (value_size + sizeof(struct stack_map_bucket));
+	if (dedup) {
+		n_frames = (u64)attr->max_entries *
+			   min_t(u32, value_size / 8,
+				 STACK_DEDUP_FRAMES_PER_STACK);
+		/* frame indexes are u32, with 0 for none */
+		if (n_frames >= U32_MAX / 2)
+			return ERR_PTR(-E2BIG);
+		n_frame_buckets = roundup_pow_of_two(n_frames);
+
+		cost = sizeof(*smap);
+		cost += (n_frames + 1) * sizeof(struct stack_map_frame);
+		cost += n_buckets * sizeof(struct stack_map_dedup_stack);
+		cost += n_frame_buckets * sizeof(u32);
+	} else {
+		cost = n_buckets * sizeof(struct stack_map_bucket *) +
+		       sizeof(*smap);
+		cost += n_buckets * (value_size +
+				     sizeof(struct stack_map_bucket));
+	}
 	err = bpf_map_charge_init(&mem, cost);
 	if (err)
 		return ERR_PTR(err);
@@ -136,9 +423,13 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto free_charge;
 
-	err = prealloc_elems_and_freelist(smap);
-	if (err)
-		goto put_buffers;
+	if (dedup) {
+		stack_map_dedup_init(smap, n_frames, n_frame_buckets);
+	} else {
+		err = prealloc_elems_and_freelist(smap);
+		if (err)
+			goto put_buffers;
+	}
 
 	bpf_map_charge_move(&smap->map.memory, &mem);
 
@@ -396,6 +687,11 @@ BPF_CALL_3(bpf_get_stackid, struct pt_regs *, regs, struct bpf_map *, map,
 	ips = trace->ip + skip + init_nr;
 	hash = jhash2((u32 *)ips, trace_len / sizeof(u32), 0);
 	id = hash & (smap->n_buckets - 1);
+
+	if (stack_map_use_dedup(map))
+		return stack_map_dedup_get_stackid(smap, ips, trace_nr, hash,
+						   id, flags);
+
 	bucket = READ_ONCE(smap->buckets[id]);
 
 	hash_matches = bucket && bucket->hash == hash;
@@ -538,6 +834,9 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	if (unlikely(id >= smap->n_buckets))
 		return -ENOENT;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_dedup_copy(smap, id, value);
+
 	bucket = xchg(&smap->buckets[id], NULL);
 	if (!bucket)
 		return -ENOENT;
@@ -565,13 +864,13 @@ static int stack_map_get_next_key(struct bpf_map *map, void *key,
 		id = 0;
 	} else {
 		id = *(u32 *)key;
-		if (id >= smap->n_buckets || !smap->buckets[id])
+		if (id >= smap->n_buckets || !stack_map_id_used(smap, id))
 			id = 0;
 		else
 			id++;
 	}
 
-	while (id < smap->n_buckets && !smap->buckets[id])
+	while (id < smap->n_buckets && !stack_map_id_used(smap, id))
 		id++;
 
 	if (id >= smap->n_buckets)
@@ -597,6 +896,9 @@ static int stack_map_delete_elem(struct bpf_map *map, void *key)
 	if (unlikely(id >= smap->n_buckets))
 		return -E2BIG;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_dedup_delete(smap, id);
+
 	old_bucket = xchg(&smap->buckets[id], NULL);
 	if (old_bucket) {
 		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
@@ -5692,7 +5692,7 @@ int __init cgroup_init(void)
 	 * The latency of the synchronize_rcu() is too high for cgroups,
 	 * avoid it at the cost of forcing all readers into the slow path.
 	 */
-	rcu_sync_enter_start(&cgroup_threadgroup_rwsem.rss);
+	percpu_rwsem_set_hybrid(&cgroup_threadgroup_rwsem);
 
 	get_user_ns(init_cgroup_ns.user_ns);
 
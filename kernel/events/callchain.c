@@ -64,7 +64,8 @@ static void release_callchain_buffers(void)
 
 	entries = callchain_cpus_entries;
 	RCU_INIT_POINTER(callchain_cpus_entries, NULL);
-	call_rcu(&entries->rcu_head, release_callchain_buffers_rcu);
+	/* Only frees memory, nobody waits for it */
+	call_rcu_lazy(&entries->rcu_head, release_callchain_buffers_rcu);
 }
 
 static int alloc_callchain_buffers(void)
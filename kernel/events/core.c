@@ -1928,6 +1928,11 @@ static bool perf_event_validate_size(struct perf_event *event)
 	__perf_event_header_size(event, event->attr.sample_type & ~PERF_SAMPLE_READ);
 	perf_event__id_header_size(event);
 
+	/* All siblings must fit the user page of a user_page_group leader */
+	if (event->group_leader->attr.user_page_group &&
+	    event->group_leader->nr_siblings >= PERF_USER_PAGE_GROUP_MAX)
+		return false;
+
 	/*
 	 * Sum the lot; should not exceed the 64k limit we have on records.
 	 * Conservative limit to allow for callchains and other variable fields.
@@ -1967,6 +1972,9 @@ static void perf_group_attach(struct perf_event *event)
 
 	for_each_sibling_event(pos, group_leader)
 		perf_event__header_size(pos);
+
+	if (group_leader->attr.user_page_group)
+		perf_event_update_userpage(group_leader);
 }
 
 /*
@@ -2169,6 +2177,9 @@ static void perf_group_detach(struct perf_event *event)
 
 	for_each_sibling_event(tmp, event->group_leader)
 		perf_event__header_size(tmp);
+
+	if (event->group_leader->attr.user_page_group)
+		perf_event_update_userpage(event->group_leader);
 }
 
 static bool is_orphaned_event(struct perf_event *event)
@@ -4787,6 +4798,7 @@ static void _free_event(struct perf_event *event)
 	perf_event_free_bpf_prog(event);
 	perf_addr_filters_splice(event, NULL);
 	kfree(event->addr_filter_ranges);
+	kfree(event->group_mapping);
 
 	if (event->destroy)
 		event->destroy(event);
@@ -5633,22 +5645,34 @@ void __weak arch_perf_update_userpage(
 {
 }
 
-/*
- * Callers need to ensure there can be no nesting of this function, otherwise
- * the seqlock logic goes bad. We can not serialize this because the arch
- * code calls this from NMI context.
- */
-void perf_event_update_userpage(struct perf_event *event)
+static void
+perf_event_update_group_userpage(struct perf_event *leader,
+				 struct perf_event_mmap_page *userpg)
+{
+	struct perf_event *sibling;
+	u32 nr = 0;
+
+	for_each_sibling_event(sibling, leader) {
+		if (nr == PERF_USER_PAGE_GROUP_MAX)
+			break;
+
+		/* 0 without rdpmc, see perf_event_group_mapped() */
+		userpg->group[nr].index = perf_event_index(sibling);
+		userpg->group[nr].offset = perf_event_count(sibling);
+		if (userpg->group[nr].index)
+			userpg->group[nr].offset -=
+				local64_read(&sibling->hw.prev_count);
+		nr++;
+	}
+	userpg->group_nr = nr;
+}
+
+static void __perf_event_update_userpage(struct perf_event *event,
+					 struct perf_buffer *rb)
 {
 	struct perf_event_mmap_page *userpg;
-	struct perf_buffer *rb;
 	u64 enabled, running, now;
 
-	rcu_read_lock();
-	rb = rcu_dereference(event->rb);
-	if (!rb)
-		goto unlock;
-
 	/*
 	 * compute total_time_enabled, total_time_running
 	 * based on snapshot values taken when the event
@@ -5681,10 +5705,86 @@ void perf_event_update_userpage(struct perf_event *event)
 
 	arch_perf_update_userpage(event, userpg, now);
 
+	if (event->attr.user_page_group)
+		perf_event_update_group_userpage(event, userpg);
+
 	barrier();
 	++userpg->lock;
 	preempt_enable();
-unlock:
+}
+
+/* The group user page this CPU is writing, and whether to write it again */
+static DEFINE_PER_CPU(struct perf_buffer *, perf_group_userpage_rb);
+static DEFINE_PER_CPU(bool, perf_group_userpage_again);
+
+/*
+ * The user page of a user_page_group leader is written for each member of
+ * the group, and the members' updates come from NMI as well. An NMI which
+ * interrupted a write of the same page on this CPU must not nest the
+ * seqlock, so it leaves the page to the interrupted writer, which writes
+ * it once more.
+ */
+static void perf_event_update_group_leader_userpage(struct perf_event *leader,
+						    struct perf_buffer *rb)
+{
+	struct perf_buffer *prev_rb;
+	unsigned long flags;
+	bool prev_again;
+
+	local_irq_save(flags);
+	prev_rb = __this_cpu_read(perf_group_userpage_rb);
+	if (prev_rb == rb) {
+		__this_cpu_write(perf_group_userpage_again, true);
+		goto out;
+	}
+
+	/* This may be an NMI which interrupted a write of another page */
+	prev_again = __this_cpu_read(perf_group_userpage_again);
+	for (;;) {
+		__this_cpu_write(perf_group_userpage_rb, rb);
+		__this_cpu_write(perf_group_userpage_again, false);
+		barrier();
+		__perf_event_update_userpage(leader, rb);
+		barrier();
+		/* From here on an NMI writes the page itself */
+		__this_cpu_write(perf_group_userpage_rb, prev_rb);
+		barrier();
+		if (!__this_cpu_read(perf_group_userpage_again))
+			break;
+	}
+	__this_cpu_write(perf_group_userpage_again, prev_again);
+out:
+	local_irq_restore(flags);
+}
+
+/*
+ * Callers need to ensure there can be no nesting of this function for the
+ * same event, otherwise the seqlock logic goes bad. We can not serialize
+ * this because the arch code calls this from NMI context. The page of a
+ * user_page_group leader, which every member of the group writes, is
+ * protected by perf_event_update_group_leader_userpage() instead.
+ */
+void perf_event_update_userpage(struct perf_event *event)
+{
+	struct perf_event *leader = event->group_leader;
+	struct perf_buffer *rb, *leader_rb = NULL;
+
+	rcu_read_lock();
+	/*
+	 * A sibling of a user_page_group leader is also visible in the
+	 * leader's user page, which must not be clobbered with the sibling's
+	 * own values when its output is redirected to the leader's buffer.
+	 */
+	if (leader->attr.user_page_group) {
+		leader_rb = rcu_dereference(leader->rb);
+		if (leader_rb)
+			perf_event_update_group_leader_userpage(leader,
+								leader_rb);
+	}
+
+	rb = rcu_dereference(event->rb);
+	if (rb && rb != leader_rb)
+		__perf_event_update_userpage(event, rb);
 	rcu_read_unlock();
 }
 EXPORT_SYMBOL_GPL(perf_event_update_userpage);
@@ -5821,6 +5921,85 @@ void ring_buffer_put(struct perf_buffer *rb)
 	call_rcu(&rb->rcu_head, rb_free_rcu);
 }
 
+/*
+ * The siblings of a user_page_group leader are read through the leader's user
+ * page, so mapping the leader maps them to their PMUs as well, which is what
+ * allows rdpmc on them on x86. Each mapping of the leader maps the siblings
+ * the group had when the leader was first mapped; those are pinned until the
+ * leader's last mapping goes away, so that each of them is unmapped again
+ * even when it left the group meanwhile. perf_event_open() does not add
+ * siblings to a mapped leader, it could not map them to the leader's mm.
+ */
+struct perf_group_mapping {
+	int			count;
+	int			nr;
+	struct perf_event	*siblings[PERF_USER_PAGE_GROUP_MAX];
+};
+
+static void perf_event_group_mapped(struct perf_event *leader,
+				    struct mm_struct *mm)
+{
+	struct perf_group_mapping *gm = leader->group_mapping;
+	struct perf_event_context *ctx;
+	struct perf_event *sibling;
+	int i;
+
+	mutex_lock(&leader->mmap_mutex);
+	if (!gm->count++) {
+		rcu_read_lock();
+again:
+		ctx = READ_ONCE(leader->ctx);
+		raw_spin_lock_irq(&ctx->lock);
+		if (ctx != leader->ctx) {
+			raw_spin_unlock_irq(&ctx->lock);
+			goto again;
+		}
+		rcu_read_unlock();
+
+		for_each_sibling_event(sibling, leader) {
+			if (gm->nr == PERF_USER_PAGE_GROUP_MAX)
+				break;
+			if (atomic_long_inc_not_zero(&sibling->refcount))
+				gm->siblings[gm->nr++] = sibling;
+		}
+		raw_spin_unlock_irq(&ctx->lock);
+	}
+
+	for (i = 0; i < gm->nr; i++) {
+		sibling = gm->siblings[i];
+		if (sibling->pmu->event_mapped)
+			sibling->pmu->event_mapped(sibling, mm);
+	}
+	mutex_unlock(&leader->mmap_mutex);
+}
+
+static void perf_event_group_unmapped(struct perf_event *leader,
+				      struct mm_struct *mm)
+{
+	struct perf_group_mapping *gm = leader->group_mapping;
+	struct perf_event *siblings[PERF_USER_PAGE_GROUP_MAX];
+	struct perf_event *sibling;
+	int i, nr = 0;
+
+	mutex_lock(&leader->mmap_mutex);
+	for (i = 0; i < gm->nr; i++) {
+		sibling = gm->siblings[i];
+		if (sibling->pmu->event_unmapped)
+			sibling->pmu->event_unmapped(sibling, mm);
+	}
+
+	if (!--gm->count) {
+		nr = gm->nr;
+		memcpy(siblings, gm->siblings, nr * sizeof(*siblings));
+		gm->nr = 0;
+	}
+	mutex_unlock(&leader->mmap_mutex);
+
+	/* Not under mmap_mutex, a sibling going away takes its own */
+	for (i = 0; i < nr; i++)
+		put_event(siblings[i]);
+}
+
 static void perf_mmap_open(struct vm_area_struct *vma)
 {
 	struct perf_event *event = vma->vm_file->private_data;
@@ -5833,6 +6012,9 @@ static void perf_mmap_open(struct vm_area_struct *vma)
 
 	if (event->pmu->event_mapped)
 		event->pmu->event_mapped(event, vma->vm_mm);
+
+	if (event->group_mapping)
+		perf_event_group_mapped(event, vma->vm_mm);
 }
 
 static void perf_pmu_output_stop(struct perf_event *event);
@@ -5857,6 +6039,9 @@ static void perf_mmap_close(struct vm_area_struct *vma)
 	if (event->pmu->event_unmapped)
 		event->pmu->event_unmapped(event, vma->vm_mm);
 
+	if (event->group_mapping)
+		perf_event_group_unmapped(event, vma->vm_mm);
+
 	/*
 	 * rb->aux_mmap_count will always drop before rb->mmap_count and
 	 * event->mmap_count, so it is ok to use event->mmap_mutex to
@@ -6174,6 +6359,9 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 	if (event->pmu->event_mapped)
 		event->pmu->event_mapped(event, vma->vm_mm);
 
+	if (!ret && event->group_mapping)
+		perf_event_group_mapped(event, vma->vm_mm);
+
 	return ret;
 }
 
@@ -11162,6 +11350,15 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 		event->addr_filters_gen = 1;
 	}
 
+	if (!event->parent && attr->user_page_group) {
+		event->group_mapping = kzalloc(sizeof(*event->group_mapping),
+					       GFP_KERNEL);
+		if (!event->group_mapping) {
+			err = -ENOMEM;
+			goto err_addr_filters;
+		}
+	}
+
 	if (!event->parent) {
 		if (event->attr.sample_type & PERF_SAMPLE_CALLCHAIN) {
 			err = get_callchain_buffers(attr->sample_max_stack);
@@ -11185,6 +11382,7 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 			put_callchain_buffers();
 	}
 err_addr_filters:
+	kfree(event->group_mapping);
 	kfree(event->addr_filter_ranges);
 
 err_per_task:
@@ -11484,6 +11682,7 @@ SYSCALL_DEFINE5(perf_event_open,
 	struct file *event_file = NULL;
 	struct fd group = {NULL, 0};
 	struct task_struct *task = NULL;
+	struct mutex *group_mmap_mutex = NULL;
 	struct pmu *pmu;
 	int event_fd;
 	int move_group = 0;
@@ -11674,6 +11873,10 @@ SYSCALL_DEFINE5(perf_event_open,
 		if (group_leader->group_leader != group_leader)
 			goto err_context;
 
+		/* Only a group leader can expose the group in its user page */
+		if (attr.user_page_group)
+			goto err_context;
+
 		/* All events in a group should have the same clock */
 		if (group_leader->clock != event->clock)
 			goto err_context;
@@ -11804,6 +12007,20 @@ SYSCALL_DEFINE5(perf_event_open,
 		goto err_locked;
 	}
 
+	/*
+	 * A mapped user_page_group leader has its siblings mapped along with
+	 * it, see perf_event_group_mapped(); a new one could not be. Hold off
+	 * mapping the leader until the event is attached.
+	 */
+	if (group_leader && group_leader->group_mapping) {
+		group_mmap_mutex = &group_leader->mmap_mutex;
+		mutex_lock(group_mmap_mutex);
+		if (group_leader->group_mapping->count) {
+			err = -EBUSY;
+			goto err_locked;
+		}
+	}
+
 	WARN_ON_ONCE(ctx->parent_ctx);
 
 	/*
@@ -11870,6 +12087,8 @@ SYSCALL_DEFINE5(perf_event_open,
 	perf_install_in_context(ctx, event, event->cpu);
 	perf_unpin_context(ctx);
 
+	if (group_mmap_mutex)
+		mutex_unlock(group_mmap_mutex);
 	if (move_group)
 		perf_event_ctx_unlock(group_leader, gctx);
 	mutex_unlock(&ctx->mutex);
@@ -11894,6 +12113,8 @@ SYSCALL_DEFINE5(perf_event_open,
 	return event_fd;
 
 err_locked:
+	if (group_mmap_mutex)
+		mutex_unlock(group_mmap_mutex);
 	if (move_group)
 		perf_event_ctx_unlock(group_leader, gctx);
 	mutex_unlock(&ctx->mutex);
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Load aware interrupt balancing
+ *
+ * Managed interrupts are spread once when they are allocated, everything
+ * else stays where it was put until somebody writes smp_affinity. This
+ * balancer periodically looks at the hard and soft interrupt time of each
+ * CPU and at the interrupt counts of each interrupt, and moves interrupts
+ * away from CPUs which spend too much time in interrupt context.
+ *
+ * A CPU is a source when its share of interrupt time reaches the high
+ * threshold and a target while it stays at or below the low threshold.
+ * The load an interrupt contributes to its CPU is estimated from its share
+ * of the interrupts that CPU handled. Only moves which leave the target
+ * less loaded than the source are done, and an interrupt which has been
+ * moved stays put for a number of intervals, so interrupts do not bounce
+ * back and forth between CPUs.
+ *
+ * Only interrupts which user space could move are considered, i.e. no
+ * managed, per CPU or NMI interrupts, and only those which target a single
+ * CPU. Interrupts are only moved to CPUs in the default affinity mask.
+ * Writing a mask to /proc/irq/N/smp_affinity or smp_affinity_list pins the
+ * interrupt and the balancer leaves it alone from then on, writing an empty
+ * mask hands it back.
+ *
+ * Control is in /proc/irq/balance/:
+ *
+ *   enable          - 1 to start balancing, 0 to stop
+ *   interval_ms     - time between two balancing passes
+ *   threshold_high  - interrupt load in percent which makes a CPU a source
+ *   threshold_low   - interrupt load in percent up to which a CPU is a target
+ *   cooldown        - passes an interrupt stays on a CPU after a move
+ */
+#include <linux/cpu.h>
+#include <linux/irq.h>
+#include <linux/interrupt.h>
+#include <linux/kernel_stat.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+struct irq_balance_cpu {
+	u64		irqtime;	/* irq and softirq time so far */
+	unsigned int	load;		/* percent of the last interval */
+	unsigned int	count;		/* interrupts of movable IRQs in it */
+};
+
+static DEFINE_PER_CPU(struct irq_balance_cpu, irq_balance_cpu);
+
+/* Protects the parameters and the balancing state */
+static DEFINE_MUTEX(irq_balance_mutex);
+
+static unsigned int irq_balance_enable;
+static unsigned int irq_balance_interval_ms = 1000;
+static unsigned int irq_balance_high = 60;
+static unsigned int irq_balance_low = 30;
+static unsigned int irq_balance_cooldown = 5;
+
+static unsigned long irq_balance_seq;
+static u64 irq_balance_last;
+static struct cpumask irq_balance_done;
+
+static void irq_balance_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(irq_balance_work, irq_balance_workfn);
+
+/*
+ * Returns the CPU an interrupt is delivered to when the balancer may move
+ * it, nr_cpu_ids otherwise. The masks are read without the descriptor
+ * lock, a stale answer only makes for a less good decision.
+ */
+static unsigned int irq_balance_cpu_of(unsigned int irq, struct irq_desc *desc)
+{
+	const struct cpumask *m;
+
+	if (!desc->action || (desc->istate & IRQS_NMI) ||
+	    !irq_can_set_affinity_usr(irq))
+		return nr_cpu_ids;
+
+	m = irq_data_get_effective_affinity_mask(&desc->irq_data);
+	if (cpumask_weight(m) != 1)
+		return nr_cpu_ids;
+
+	return cpumask_first(m);
+}
+
+static void irq_balance_sample(u64 period)
+{
+	struct irq_balance_cpu *bc;
+	struct irq_desc *desc;
+	unsigned int irq, cpu, cnt;
+	u64 t;
+
+	for_each_online_cpu(cpu) {
+		bc = per_cpu_ptr(&irq_balance_cpu, cpu);
+		t = kcpustat_cpu(cpu).cpustat[CPUTIME_IRQ] +
+		    kcpustat_cpu(cpu).cpustat[CPUTIME_SOFTIRQ];
+		bc->load = period ?
+			min_t(u64, div64_u64((t - bc->irqtime) * 100, period),
+			      100) : 0;
+		bc->irqtime = t;
+		bc->count = 0;
+	}
+
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc)
+			continue;
+
+		cnt = kstat_irqs(irq);
+		desc->balance_delta = cnt - desc->balance_count;
+		desc->balance_count = cnt;
+
+		cpu = irq_balance_cpu_of(irq, desc);
+		if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+			continue;
+		bc = per_cpu_ptr(&irq_balance_cpu, cpu);
+		bc->count += desc->balance_delta;
+	}
+}
+
+/* Find the most loaded source and the least loaded target CPU */
+static bool irq_balance_pick_cpus(unsigned int *src, unsigned int *dst)
+{
+	struct irq_balance_cpu *bc;
+	unsigned int cpu, hi = 0, lo = UINT_MAX;
+
+	*src = *dst = nr_cpu_ids;
+	for_each_online_cpu(cpu) {
+		bc = per_cpu_ptr(&irq_balance_cpu, cpu);
+
+		if (bc->load >= irq_balance_high && bc->load > hi &&
+		    bc->count && !cpumask_test_cpu(cpu, &irq_balance_done)) {
+			hi = bc->load;
+			*src = cpu;
+		}
+		if (bc->load <= irq_balance_low && bc->load < lo &&
+		    cpumask_test_cpu(cpu, irq_default_affinity)) {
+			lo = bc->load;
+			*dst = cpu;
+		}
+	}
+
+	return *src < nr_cpu_ids && *dst < nr_cpu_ids;
+}
+
+/*
+ * Move the interrupt with the largest estimated load off @src, as long as
+ * that leaves @dst below @src. Returns false when no interrupt qualifies.
+ */
+static bool irq_balance_move_one(unsigned int src, unsigned int dst)
+{
+	struct irq_balance_cpu *sbc = per_cpu_ptr(&irq_balance_cpu, src);
+	struct irq_balance_cpu *dbc = per_cpu_ptr(&irq_balance_cpu, dst);
+	unsigned int irq, best_irq = 0, load, best_load = 0;
+	struct irq_desc *desc, *best = NULL;
+
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc || !desc->balance_delta ||
+		    READ_ONCE(desc->balance_user))
+			continue;
+		if (irq_balance_cpu_of(irq, desc) != src)
+			continue;
+		if (desc->balance_moved && irq_balance_seq -
+		    desc->balance_moved < irq_balance_cooldown)
+			continue;
+
+		load = div_u64((u64)sbc->load * desc->balance_delta,
+			       sbc->count);
+		if (load <= best_load || dbc->load + 2 * load >= sbc->load)
+			continue;
+
+		best = desc;
+		best_irq = irq;
+		best_load = load;
+	}
+
+	if (!best || irq_set_affinity(best_irq, cpumask_of(dst)))
+		return false;
+
+	best->balance_moved = irq_balance_seq;
+	sbc->load -= best_load;
+	sbc->count -= best->balance_delta;
+	dbc->load += best_load;
+	dbc->count += best->balance_delta;
+
+	return true;
+}
+
+static void irq_balance_run(void)
+{
+	unsigned int src, dst;
+	u64 now = ktime_get_ns();
+
+	cpus_read_lock();
+	irq_lock_sparse();
+
+	irq_balance_sample(irq_balance_last ? now - irq_balance_last : 0);
+	irq_balance_last = now;
+	irq_balance_seq++;
+
+	/* At most one interrupt per source CPU and pass */
+	cpumask_clear(&irq_balance_done);
+	while (irq_balance_pick_cpus(&src, &dst)) {
+		cpumask_set_cpu(src, &irq_balance_done);
+		irq_balance_move_one(src, dst);
+	}
+
+	irq_unlock_sparse();
+	cpus_read_unlock();
+}
+
+static void irq_balance_workfn(struct work_struct *work)
+{
+	mutex_lock(&irq_balance_mutex);
+	if (irq_balance_enable) {
+		irq_balance_run();
+		queue_delayed_work(system_unbound_wq, &irq_balance_work,
+				   msecs_to_jiffies(irq_balance_interval_ms));
+	}
+	mutex_unlock(&irq_balance_mutex);
+}
+
+static bool irq_balance_params_valid(void)
+{
+	return irq_balance_enable <= 1 && irq_balance_interval_ms >= 10 &&
+	       irq_balance_high <= 100 && irq_balance_low < irq_balance_high;
+}
+
+static int irq_balance_param_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "%u\n", *(unsigned int *)m->private);
+	return 0;
+}
+
+static int irq_balance_param_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_balance_param_show, PDE_DATA(inode));
+}
+
+static ssize_t irq_balance_param_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *ppos)
+{
+	unsigned int *param = PDE_DATA(file_inode(file));
+	unsigned int val, old;
+	int err;
+
+	err = kstrtouint_from_user(buffer, count, 0, &val);
+	if (err)
+		return err;
+
+	mutex_lock(&irq_balance_mutex);
+	old = *param;
+	*param = val;
+	if (!irq_balance_params_valid()) {
+		*param = old;
+		err = -EINVAL;
+	} else if (param == &irq_balance_enable && val != old) {
+		if (val) {
+			/* The first pass only takes a sample */
+			irq_balance_last = 0;
+			queue_delayed_work(system_unbound_wq,
+					   &irq_balance_work, 0);
+		} else {
+			cancel_delayed_work(&irq_balance_work);
+		}
+	}
+	mutex_unlock(&irq_balance_mutex);
+
+	return err ? err : count;
+}
+
+static const struct proc_ops irq_balance_param_proc_ops = {
+	.proc_open	= irq_balance_param_open,
+	.proc_read	= seq_read,
+	.proc_lseek	= seq_lseek,
+	.proc_release	= single_release,
+	.proc_write	= irq_balance_param_write,
+};
+
+void __init register_irq_balance_proc(struct proc_dir_entry *root_irq_dir)
+{
+	struct proc_dir_entry *dir = proc_mkdir("balance", root_irq_dir);
+
+	if (!dir)
+		return;
+
+	proc_create_data("enable", 0644, dir, &irq_balance_param_proc_ops,
+			 &irq_balance_enable);
+	proc_create_data("interval_ms", 0644, dir, &irq_balance_param_proc_ops,
+			 &irq_balance_interval_ms);
+	proc_create_data("threshold_high", 0644, dir,
+			 &irq_balance_param_proc_ops, &irq_balance_high);
+	proc_create_data("threshold_low", 0644, dir,
+			 &irq_balance_param_proc_ops, &irq_balance_low);
+	proc_create_data("cooldown", 0644, dir, &irq_balance_param_proc_ops,
+			 &irq_balance_cooldown);
+}
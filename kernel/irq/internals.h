@@ -128,6 +128,22 @@ static inline void unregister_handler_proc(unsigned int irq,
 
 extern bool irq_can_set_affinity_usr(unsigned int irq);
 
+#ifdef CONFIG_IRQ_BALANCE
+extern void register_irq_balance_proc(struct proc_dir_entry *root_irq_dir);
+
+static inline void irq_balance_set_user(unsigned int irq, bool user)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	if (desc)
+		WRITE_ONCE(desc->balance_user, user);
+}
+#else
+static inline void
+register_irq_balance_proc(struct proc_dir_entry *root_irq_dir) { }
+static inline void irq_balance_set_user(unsigned int irq, bool user) { }
+#endif
+
 extern void irq_set_thread_affinity(struct irq_desc *desc);
 
 extern int irq_do_set_affinity(struct irq_data *data,
@@ -165,10 +165,14 @@ static ssize_t write_irq_affinity(int type, struct file *file,
 		 * to set default SMP affinity.
 		 */
 		err = irq_select_affinity_usr(irq) ? -EINVAL : count;
+		if (err == count)
+			irq_balance_set_user(irq, false);
 	} else {
 		err = irq_set_affinity(irq, new_value);
-		if (!err)
+		if (!err) {
+			irq_balance_set_user(irq, true);
 			err = count;
+		}
 	}
 
 free_cpumask:
@@ -438,6 +442,7 @@ void init_irq_proc(void)
 		return;
 
 	register_default_affinity_proc();
+	register_irq_balance_proc(root_irq_dir);
 
 	/*
 	 * Create entries for all existing IRQs.
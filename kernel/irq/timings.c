@@ -27,6 +27,7 @@ void irq_timings_enable(void)
 {
 	static_branch_enable(&irq_timing_enabled);
 }
+EXPORT_SYMBOL_GPL(irq_timings_enable);
 
 void irq_timings_disable(void)
 {
@@ -502,6 +503,25 @@ static inline void irq_timings_store(int irq, struct irqt_stat *irqs, u64 ts)
 	__irq_timings_store(irq, irqs, interval);
 }
 
+/*
+ * Inject measured irq/timestamp to the pattern prediction model while
+ * decrementing the counter because we consume the data from our
+ * circular buffer.
+ */
+static void irq_timings_consume(struct irq_timings *irqts)
+{
+	struct irqt_stat __percpu *s;
+	int i, irq;
+	u64 ts;
+
+	for_each_irqts(i, irqts) {
+		irq = irq_timing_decode(irqts->values[i], &ts);
+		s = idr_find(&irqt_stats, irq);
+		if (s)
+			irq_timings_store(irq, this_cpu_ptr(s), ts);
+	}
+}
+
 /**
  * irq_timings_next_event - Return when the next event is supposed to arrive
  *
@@ -534,7 +554,7 @@ u64 irq_timings_next_event(u64 now)
 	struct irqt_stat *irqs;
 	struct irqt_stat __percpu *s;
 	u64 ts, next_evt = U64_MAX;
-	int i, irq = 0;
+	int i;
 
 	/*
 	 * This function must be called with the local irq disabled in
@@ -555,17 +575,8 @@ u64 irq_timings_next_event(u64 now)
 	 * in a nicer way with the proper circular array structure
 	 * type but with the cost of extra computation in the
 	 * interrupt handler hot path. We choose efficiency.
-	 *
-	 * Inject measured irq/timestamp to the pattern prediction
-	 * model while decrementing the counter because we consume the
-	 * data from our circular buffer.
 	 */
-	for_each_irqts(i, irqts) {
-		irq = irq_timing_decode(irqts->values[i], &ts);
-		s = idr_find(&irqt_stats, irq);
-		if (s)
-			irq_timings_store(irq, this_cpu_ptr(s), ts);
-	}
+	irq_timings_consume(irqts);
 
 	/*
 	 * Look in the list of interrupts' statistics, the earliest
@@ -586,6 +597,45 @@ u64 irq_timings_next_event(u64 now)
 	return next_evt;
 }
 
+/**
+ * irq_timings_interval - Return the predicted interval of an interrupt
+ * @irq: the interrupt number
+ *
+ * Feeds the interrupts recorded on this CPU so far into the prediction
+ * model, then returns the interval in nanoseconds after which @irq is
+ * expected to fire again, based on the repeating pattern of its intervals
+ * if there is one and on the shortest observed interval otherwise. Drivers
+ * can use this to adapt their interrupt moderation to the arrival pattern.
+ *
+ * The statistics are per CPU, so this must be called with interrupts
+ * disabled on the CPU which handles @irq, typically from its handler.
+ *
+ * Returns U64_MAX when there is no prediction for @irq, e.g. because it
+ * has not fired for a second or often enough yet.
+ */
+u64 irq_timings_interval(unsigned int irq)
+{
+	struct irqt_stat __percpu *s;
+	struct irqt_stat *irqs;
+	u64 next;
+
+	lockdep_assert_irqs_disabled();
+
+	irq_timings_consume(this_cpu_ptr(&irq_timings));
+
+	s = idr_find(&irqt_stats, irq);
+	if (!s)
+		return U64_MAX;
+
+	irqs = this_cpu_ptr(s);
+	next = __irq_timings_next_event(irqs, irq, local_clock());
+	if (next == U64_MAX || next <= irqs->last_ts)
+		return U64_MAX;
+
+	return next - irqs->last_ts;
+}
+EXPORT_SYMBOL_GPL(irq_timings_interval);
+
 void irq_timings_free(int irq)
 {
 	struct irqt_stat __percpu *s;
@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sampled lock contention profiler
+ *
+ * lock_stat needs full lockdep, which is far too slow to leave on in
+ * production. This profiler instead samples one in every sample_period
+ * contended acquisitions in the mutex, rwsem and qspinlock slowpaths and
+ * records, per (lock address, call site) pair, the number of samples, the
+ * total and maximum wait time and a log2 histogram of the wait times.
+ *
+ * Everything is reported under <debugfs>/lock_contention/:
+ *
+ *   enable         - write 1 to start sampling, 0 to stop
+ *   sample_period  - sample 1 in N contended acquisitions per CPU
+ *   stats          - the per call site statistics
+ *   .reset         - write anything to clear the statistics
+ *
+ * The table is a fixed size open-addressed hash whose slots are claimed with
+ * cmpxchg() and updated with atomics, so recording never takes a lock. A
+ * sample whose slot cannot be found within a few probes is only counted as
+ * dropped. Like the lock event counts, resetting is not synchronized against
+ * concurrent recording and may leave a few stray samples behind.
+ */
+#include <linux/debugfs.h>
+#include <linux/hardirq.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/debug.h>
+#include <linux/seq_file.h>
+#include <linux/stacktrace.h>
+
+#include "lock_contention.h"
+
+#define LOCK_CONTENTION_DIR	"lock_contention"
+
+#define LC_HASH_BITS		10
+#define LC_NR_ENTRIES		(1 << LC_HASH_BITS)
+#define LC_MAX_PROBES		16
+#define LC_STACK_DEPTH		16
+
+/*
+ * Wait time histogram: bucket 0 is < 1us, bucket n is [2^(n-1), 2^n) us and
+ * the last bucket collects everything from 16ms up.
+ */
+#define LC_HIST_BUCKETS		16
+
+struct lc_entry {
+	unsigned long	key;		/* hash of lock, ip and type, or 0 */
+	void		*lock;
+	unsigned long	ip;
+	int		type;
+	int		valid;
+	atomic_long_t	count;
+	atomic64_t	total_ns;
+	atomic64_t	max_ns;
+	atomic_t	hist[LC_HIST_BUCKETS];
+};
+
+DEFINE_STATIC_KEY_FALSE(lock_contention_key);
+
+static struct lc_entry lc_table[LC_NR_ENTRIES];
+static atomic_long_t lc_dropped;
+static u32 lc_sample_period = 64;
+
+static DEFINE_PER_CPU(u32, lc_countdown);
+static DEFINE_PER_CPU(int, lc_recursion);
+
+static const char * const lc_type_names[LOCK_CONTENTION_NR_TYPES] = {
+	[LOCK_CONTENTION_SPIN]		= "spin",
+	[LOCK_CONTENTION_MUTEX]		= "mutex",
+	[LOCK_CONTENTION_RWSEM_READ]	= "rwsem-read",
+	[LOCK_CONTENTION_RWSEM_WRITE]	= "rwsem-write",
+};
+
+u64 __lock_contention_begin(void)
+{
+	u32 left;
+
+	/* The recording side is not NMI safe on all architectures. */
+	if (in_nmi())
+		return 0;
+
+	/*
+	 * Per-cpu countdown; use raw_cpu ops as we don't care about the
+	 * occasional lost update when preempted in between.
+	 */
+	left = raw_cpu_read(lc_countdown);
+	if (left > 1) {
+		raw_cpu_write(lc_countdown, left - 1);
+		return 0;
+	}
+	raw_cpu_write(lc_countdown, READ_ONCE(lc_sample_period));
+
+	return local_clock() ?: 1;
+}
+
+/*
+ * Find the first caller outside of the locking and scheduler code. The
+ * slowpath itself may sit below the lock functions (qspinlock), so skip
+ * everything up to and including the first run of such frames.
+ */
+static unsigned long lc_call_site(unsigned long ip)
+{
+	unsigned long entries[LC_STACK_DEPTH];
+	unsigned int i, nr;
+	bool seen_lock = false;
+
+	if (ip && !in_sched_functions(ip))
+		return ip;
+
+	nr = stack_trace_save(entries, ARRAY_SIZE(entries), 0);
+	for (i = 0; i < nr; i++) {
+		if (in_sched_functions(entries[i]))
+			seen_lock = true;
+		else if (seen_lock)
+			return entries[i];
+	}
+
+	return ip;
+}
+
+static struct lc_entry *lc_get_entry(void *lock, unsigned long ip, int type)
+{
+	unsigned long key = hash_long(ip + type, BITS_PER_LONG);
+	unsigned int idx, i;
+
+	key = hash_long((unsigned long)lock ^ key, BITS_PER_LONG) | 1;
+	idx = hash_long(key, LC_HASH_BITS);
+
+	for (i = 0; i < LC_MAX_PROBES; i++) {
+		struct lc_entry *e = &lc_table[(idx + i) & (LC_NR_ENTRIES - 1)];
+		unsigned long cur = READ_ONCE(e->key);
+
+		if (!cur) {
+			cur = cmpxchg(&e->key, 0, key);
+			if (!cur) {
+				e->lock = lock;
+				e->ip = ip;
+				e->type = type;
+				/* Pairs with lc_stats_show() */
+				smp_store_release(&e->valid, 1);
+				return e;
+			}
+		}
+		if (cur == key)
+			return e;
+	}
+
+	return NULL;
+}
+
+static void lc_account(struct lc_entry *e, u64 delta)
+{
+	u64 us = delta >> 10;
+	s64 old, prev;
+	int bucket;
+
+	bucket = us ? min_t(int, ilog2(us) + 1, LC_HIST_BUCKETS - 1) : 0;
+
+	atomic_long_inc(&e->count);
+	atomic64_add(delta, &e->total_ns);
+	atomic_inc(&e->hist[bucket]);
+
+	old = atomic64_read(&e->max_ns);
+	while ((u64)old < delta) {
+		prev = atomic64_cmpxchg(&e->max_ns, old, delta);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
+void __lock_contention_end(void *lock, enum lock_contention_type type,
+			   u64 start, unsigned long ip)
+{
+	u64 now = local_clock();
+	unsigned long flags;
+	struct lc_entry *e;
+
+	/*
+	 * Sleeping lock waiters may finish on another CPU whose clock is
+	 * slightly behind.
+	 */
+	if ((s64)(now - start) < 0)
+		now = start;
+
+	local_irq_save(flags);
+	/*
+	 * Don't recurse through any lock taken while recording, e.g. the
+	 * hashed spinlocks of the generic atomic64 implementation.
+	 */
+	if (__this_cpu_inc_return(lc_recursion) == 1) {
+		e = lc_get_entry(lock, lc_call_site(ip), type);
+		if (e)
+			lc_account(e, now - start);
+		else
+			atomic_long_inc(&lc_dropped);
+	}
+	__this_cpu_dec(lc_recursion);
+	local_irq_restore(flags);
+}
+
+static int lc_stats_show(struct seq_file *m, void *v)
+{
+	int i, j;
+
+	seq_printf(m, "# sample_period %u, dropped %ld\n",
+		   READ_ONCE(lc_sample_period), atomic_long_read(&lc_dropped));
+	seq_puts(m, "# type lock call_site samples total_ns max_ns avg_ns hist[<1us 1us 2us 4us ... >=16ms]\n");
+
+	for (i = 0; i < LC_NR_ENTRIES; i++) {
+		struct lc_entry *e = &lc_table[i];
+		long count;
+
+		/* Pairs with lc_get_entry() filling in the entry */
+		if (!smp_load_acquire(&e->valid))
+			continue;
+
+		count = atomic_long_read(&e->count);
+		if (!count)
+			continue;
+
+		seq_printf(m, "%s %p %pS %ld %lld %lld %lld",
+			   lc_type_names[e->type], e->lock, (void *)e->ip,
+			   count, atomic64_read(&e->total_ns),
+			   atomic64_read(&e->max_ns),
+			   div64_s64(atomic64_read(&e->total_ns), count));
+		for (j = 0; j < LC_HIST_BUCKETS; j++)
+			seq_printf(m, " %d", atomic_read(&e->hist[j]));
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lc_stats);
+
+static ssize_t lc_reset_write(struct file *file, const char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	int i;
+
+	for (i = 0; i < LC_NR_ENTRIES; i++) {
+		struct lc_entry *e = &lc_table[i];
+
+		WRITE_ONCE(e->valid, 0);
+		/* Hide the entry from readers before clearing it */
+		smp_wmb();
+		memset(&e->count, 0,
+		       sizeof(*e) - offsetof(struct lc_entry, count));
+		WRITE_ONCE(e->key, 0);
+	}
+	atomic_long_set(&lc_dropped, 0);
+
+	return count;
+}
+
+static const struct file_operations fops_lc_reset = {
+	.write = lc_reset_write,
+	.llseek = default_llseek,
+};
+
+static int lc_enable_get(void *data, u64 *val)
+{
+	*val = static_key_enabled(&lock_contention_key);
+	return 0;
+}
+
+static int lc_enable_set(void *data, u64 val)
+{
+	if (val)
+		static_branch_enable(&lock_contention_key);
+	else
+		static_branch_disable(&lock_contention_key);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(fops_lc_enable, lc_enable_get, lc_enable_set,
+			 "%llu\n");
+
+/*
+ * Initialize debugfs for the lock contention profiler.
+ */
+static int __init init_lock_contention(void)
+{
+	struct dentry *d_lc = debugfs_create_dir(LOCK_CONTENTION_DIR, NULL);
+
+	/*
+	 * As with the lock event counts, only root may look at or change
+	 * the profiler state.
+	 */
+	debugfs_create_file_unsafe("enable", 0600, d_lc, NULL, &fops_lc_enable);
+	debugfs_create_u32("sample_period", 0600, d_lc, &lc_sample_period);
+	debugfs_create_file("stats", 0400, d_lc, NULL, &lc_stats_fops);
+	debugfs_create_file(".reset", 0200, d_lc, NULL, &fops_lc_reset);
+
+	return 0;
+}
+fs_initcall(init_lock_contention);
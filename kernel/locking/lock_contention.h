@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Sampled lock contention profiling for the sleeping lock and qspinlock
+ * slowpaths. Unlike lock_stat it does not depend on lockdep, and costs a
+ * single static branch per contended acquisition while it is switched off.
+ */
+
+#ifndef __LOCKING_LOCK_CONTENTION_H
+#define __LOCKING_LOCK_CONTENTION_H
+
+#include <linux/jump_label.h>
+#include <linux/types.h>
+
+enum lock_contention_type {
+	LOCK_CONTENTION_SPIN,
+	LOCK_CONTENTION_MUTEX,
+	LOCK_CONTENTION_RWSEM_READ,
+	LOCK_CONTENTION_RWSEM_WRITE,
+	LOCK_CONTENTION_NR_TYPES,
+};
+
+#ifdef CONFIG_LOCK_CONTENTION_PROFILE
+DECLARE_STATIC_KEY_FALSE(lock_contention_key);
+
+extern u64 __lock_contention_begin(void);
+extern void __lock_contention_end(void *lock, enum lock_contention_type type,
+				  u64 start, unsigned long ip);
+
+/*
+ * Called once a lock acquisition is known to be contended. Returns the start
+ * timestamp if this acquisition is sampled, 0 otherwise.
+ */
+static __always_inline u64 lock_contention_begin(void)
+{
+	if (static_branch_unlikely(&lock_contention_key))
+		return __lock_contention_begin();
+	return 0;
+}
+
+/*
+ * Called once the lock has been acquired. @ip is the best known call site;
+ * if it points into the locking code itself the stack is walked to find the
+ * real caller.
+ */
+static __always_inline void lock_contention_end(void *lock,
+						enum lock_contention_type type,
+						u64 start, unsigned long ip)
+{
+	if (unlikely(start))
+		__lock_contention_end(lock, type, start, ip);
+}
+
+#else  /* CONFIG_LOCK_CONTENTION_PROFILE */
+
+static inline u64 lock_contention_begin(void)
+{
+	return 0;
+}
+
+static inline void lock_contention_end(void *lock,
+				       enum lock_contention_type type,
+				       u64 start, unsigned long ip) { }
+
+#endif /* CONFIG_LOCK_CONTENTION_PROFILE */
+#endif /* __LOCKING_LOCK_CONTENTION_H */
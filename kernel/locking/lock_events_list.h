@@ -47,6 +47,16 @@ LOCK_EVENT(lock_use_node2)	/* # of locking ops that use 2nd percpu node */
 LOCK_EVENT(lock_use_node3)	/* # of locking ops that use 3rd percpu node */
 LOCK_EVENT(lock_use_node4)	/* # of locking ops that use 4th percpu node */
 LOCK_EVENT(lock_no_node)	/* # of locking ops w/o using percpu node    */
+
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+/*
+ * Locking events for the NUMA-aware (CNA) qspinlock slowpath
+ */
+LOCK_EVENT(cna_intra_node)	/* # of handoffs within the holder's node    */
+LOCK_EVENT(cna_inter_node)	/* # of handoffs to another node	     */
+LOCK_EVENT(cna_reorder)		/* # of waiter runs moved to 2ndary queue    */
+LOCK_EVENT(cna_flush)		/* # of 2ndary queue splices back into main  */
+#endif /* CONFIG_NUMA_AWARE_SPINLOCKS */
 #endif /* CONFIG_QUEUED_SPINLOCKS */
 
 /*
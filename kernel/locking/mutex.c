@@ -30,6 +30,8 @@
 #include <linux/debug_locks.h>
 #include <linux/osq_lock.h>
 
+#include "lock_contention.h"
+
 #ifdef CONFIG_DEBUG_MUTEXES
 # include "mutex-debug.h"
 #else
@@ -930,6 +932,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	struct mutex_waiter waiter;
 	bool first = false;
 	struct ww_mutex *ww;
+	u64 wait_start = 0;
 	int ret;
 
 	might_sleep();
@@ -979,6 +982,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	debug_mutex_lock_common(lock, &waiter);
 
 	lock_contended(&lock->dep_map, ip);
+	wait_start = lock_contention_begin();
 
 	if (!use_ww_ctx) {
 		/* add waiting tasks to the end of the waitqueue (FIFO): */
@@ -1082,6 +1086,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 		ww_mutex_lock_acquired(ww, ww_ctx);
 
 	spin_unlock(&lock->wait_lock);
+	lock_contention_end(lock, LOCK_CONTENTION_MUTEX, wait_start, ip);
 	preempt_enable();
 	return 0;
 
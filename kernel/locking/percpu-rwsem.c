@@ -20,6 +20,7 @@ int __percpu_init_rwsem(struct percpu_rw_semaphore *sem,
 	rcuwait_init(&sem->writer);
 	init_waitqueue_head(&sem->waiters);
 	atomic_set(&sem->block, 0);
+	sem->hybrid = false;
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	debug_check_no_locks_freed((void *)sem, sizeof(*sem));
 	lockdep_init_map(&sem->dep_map, name, key, 0);
@@ -37,12 +38,33 @@ void percpu_free_rwsem(struct percpu_rw_semaphore *sem)
 	if (!sem->read_count)
 		return;
 
+	if (sem->hybrid)
+		rcu_sync_exit(&sem->rss);
 	rcu_sync_dtor(&sem->rss);
 	free_percpu(sem->read_count);
 	sem->read_count = NULL; /* catch use after free bugs */
 }
 EXPORT_SYMBOL_GPL(percpu_free_rwsem);
 
+/**
+ * percpu_rwsem_set_hybrid - keep readers on the counting slow path for good
+ * @sem: percpu_rw_semaphore that has been initialized but not yet used
+ *
+ * Normally readers only touch their per-CPU count, and every writer pays for
+ * that with an RCU grace period to push them onto the slow path. When writers
+ * are not rare that grace period dominates. In hybrid mode readers always
+ * bump their per-CPU count, issue a full barrier and check sem->block, so a
+ * writer only has to wait for the active readers to drain. Readers still do
+ * not write any shared cacheline unless a writer is pending, at which point
+ * they queue on sem->waiters like any other blocked reader.
+ */
+void percpu_rwsem_set_hybrid(struct percpu_rw_semaphore *sem)
+{
+	rcu_sync_enter_start(&sem->rss);
+	sem->hybrid = true;
+}
+EXPORT_SYMBOL_GPL(percpu_rwsem_set_hybrid);
+
 static bool __percpu_down_read_trylock(struct percpu_rw_semaphore *sem)
 {
 	__this_cpu_inc(*sem->read_count);
@@ -216,8 +238,9 @@ void percpu_down_write(struct percpu_rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
 
-	/* Notify readers to take the slow path. */
-	rcu_sync_enter(&sem->rss);
+	/* Notify readers to take the slow path; hybrid ones always do. */
+	if (!sem->hybrid)
+		rcu_sync_enter(&sem->rss);
 
 	/*
 	 * Try set sem->block; this provides writer-writer exclusion.
@@ -265,6 +288,7 @@ void percpu_up_write(struct percpu_rw_semaphore *sem)
 	 * reader fast path will be available again. Safe to use outside the
 	 * exclusive write lock because its counting.
 	 */
-	rcu_sync_exit(&sem->rss);
+	if (!sem->hybrid)
+		rcu_sync_exit(&sem->rss);
 }
 EXPORT_SYMBOL_GPL(percpu_up_write);
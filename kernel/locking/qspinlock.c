@@ -11,7 +11,7 @@
  *          Peter Zijlstra <peterz@infradead.org>
  */
 
-#ifndef _GEN_PV_LOCK_SLOWPATH
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && !defined(_GEN_CNA_LOCK_SLOWPATH)
 
 #include <linux/smp.h>
 #include <linux/bug.h>
@@ -27,6 +27,7 @@
  * Include queued spinlock statistics code
  */
 #include "qspinlock_stat.h"
+#include "lock_contention.h"
 
 /*
  * The basic principle of a queue-based spinlock can best be understood
@@ -76,11 +77,12 @@
  * two of them can fit in a cacheline in this case. That is OK as it is rare
  * to have more than 2 levels of slowpath nesting in actual use. We don't
  * want to penalize pvqspinlocks to optimize for a rare case in native
- * qspinlocks.
+ * qspinlocks. The NUMA-aware (CNA) slowpath keeps its per-node state in the
+ * same padding.
  */
 struct qnode {
 	struct mcs_spinlock mcs;
-#ifdef CONFIG_PARAVIRT_SPINLOCKS
+#if defined(CONFIG_PARAVIRT_SPINLOCKS) || defined(CONFIG_NUMA_AWARE_SPINLOCKS)
 	long reserved[2];
 #endif
 };
@@ -285,11 +287,41 @@ static __always_inline u32  __pv_wait_head_or_lock(struct qspinlock *lock,
 #define pv_kick_node		__pv_kick_node
 #define pv_wait_head_or_lock	__pv_wait_head_or_lock
 
+/*
+ * Plain MCS queueing; the NUMA-aware slowpath replaces these to reorder the
+ * queue at handoff time.
+ */
+static __always_inline void __mcs_init_node(struct mcs_spinlock *node) { }
+
+static __always_inline bool __try_clear_tail(struct qspinlock *lock, u32 val,
+					     struct mcs_spinlock *node)
+{
+	return atomic_try_cmpxchg_relaxed(&lock->val, &val, _Q_LOCKED_VAL);
+}
+
+static __always_inline void __mcs_lock_handoff(struct mcs_spinlock *node,
+					       struct mcs_spinlock *next)
+{
+	arch_mcs_spin_unlock_contended(&next->locked);
+}
+
+#define mcs_init_node		__mcs_init_node
+#define try_clear_tail		__try_clear_tail
+#define mcs_lock_handoff	__mcs_lock_handoff
+
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+static bool numa_spinlock_enabled __ro_after_init;
+
+#define cna_enabled()		READ_ONCE(numa_spinlock_enabled)
+#else
+#define cna_enabled()		false
+#endif
+
 #ifdef CONFIG_PARAVIRT_SPINLOCKS
 #define queued_spin_lock_slowpath	native_queued_spin_lock_slowpath
 #endif
 
-#endif /* _GEN_PV_LOCK_SLOWPATH */
+#endif /* !_GEN_PV_LOCK_SLOWPATH && !_GEN_CNA_LOCK_SLOWPATH */
 
 /**
  * queued_spin_lock_slowpath - acquire the queued spinlock
@@ -315,11 +347,19 @@ static __always_inline u32  __pv_wait_head_or_lock(struct qspinlock *lock,
 void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 {
 	struct mcs_spinlock *prev, *next, *node;
+	u64 wait_start;
 	u32 old, tail;
 	int idx;
 
 	BUILD_BUG_ON(CONFIG_NR_CPUS >= (1U << _Q_TAIL_CPU_BITS));
 
+	if (cna_enabled()) {
+		__cna_queued_spin_lock_slowpath(lock, val);
+		return;
+	}
+
+	wait_start = lock_contention_begin();
+
 	if (pv_enabled())
 		goto pv_queue;
 
@@ -388,6 +428,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 */
 	clear_pending_set_locked(lock);
 	lockevent_inc(lock_pending);
+	lock_contention_end(lock, LOCK_CONTENTION_SPIN, wait_start, _RET_IP_);
 	return;
 
 	/*
@@ -433,6 +474,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 
 	node->locked = 0;
 	node->next = NULL;
+	mcs_init_node(node);
 	pv_init_node(node);
 
 	/*
@@ -533,7 +575,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 *       PENDING will make the uncontended transition fail.
 	 */
 	if ((val & _Q_TAIL_MASK) == tail) {
-		if (atomic_try_cmpxchg_relaxed(&lock->val, &val, _Q_LOCKED_VAL))
+		if (try_clear_tail(lock, val, node))
 			goto release; /* No contention */
 	}
 
@@ -550,7 +592,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	if (!next)
 		next = smp_cond_load_relaxed(&node->next, (VAL));
 
-	arch_mcs_spin_unlock_contended(&next->locked);
+	mcs_lock_handoff(node, next);
 	pv_kick_node(lock, next);
 
 release:
@@ -558,13 +600,51 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 * release the node
 	 */
 	__this_cpu_dec(qnodes[0].mcs.count);
+	lock_contention_end(lock, LOCK_CONTENTION_SPIN, wait_start, _RET_IP_);
 }
 EXPORT_SYMBOL(queued_spin_lock_slowpath);
 
+/*
+ * Generate the NUMA-aware code for queued_spin_lock_slowpath().
+ */
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && !defined(_GEN_CNA_LOCK_SLOWPATH) && \
+    defined(CONFIG_NUMA_AWARE_SPINLOCKS)
+#define _GEN_CNA_LOCK_SLOWPATH
+
+#undef  cna_enabled
+#define cna_enabled()	false
+
+#undef  mcs_init_node
+#define mcs_init_node		cna_init_node
+#undef  try_clear_tail
+#define try_clear_tail		cna_try_clear_tail
+#undef  mcs_lock_handoff
+#define mcs_lock_handoff	cna_lock_handoff
+
+#undef  queued_spin_lock_slowpath
+#define queued_spin_lock_slowpath	__cna_queued_spin_lock_slowpath
+
+#include "qspinlock_cna.h"
+#include "qspinlock.c"
+
+/*
+ * Back to plain MCS queueing for the paravirt slowpath below.
+ */
+#undef  mcs_init_node
+#define mcs_init_node		__mcs_init_node
+#undef  try_clear_tail
+#define try_clear_tail		__try_clear_tail
+#undef  mcs_lock_handoff
+#define mcs_lock_handoff	__mcs_lock_handoff
+
+#undef  _GEN_CNA_LOCK_SLOWPATH
+#endif
+
 /*
  * Generate the paravirt code for queued_spin_unlock_slowpath().
  */
-#if !defined(_GEN_PV_LOCK_SLOWPATH) && defined(CONFIG_PARAVIRT_SPINLOCKS)
+#if !defined(_GEN_PV_LOCK_SLOWPATH) && !defined(_GEN_CNA_LOCK_SLOWPATH) && \
+    defined(CONFIG_PARAVIRT_SPINLOCKS)
 #define _GEN_PV_LOCK_SLOWPATH
 
 #undef  pv_enabled
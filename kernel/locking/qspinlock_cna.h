@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes. Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Primary queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded pointer to the tail of the secondary queue, which is organized as a
+ * circular list.
+ *
+ * At the handoff time, the lock holder scans the primary queue for a waiter
+ * running on its own NUMA node. The waiters in front of that one are moved to
+ * the tail of the secondary queue, and the lock is passed to the local
+ * waiter along with the secondary queue. If no local waiter is found, the
+ * secondary queue is spliced back in front of the primary queue so the
+ * longest remote waiters go first.
+ *
+ * To keep remote waiters from starving, the lock is passed within a node at
+ * most numa_spinlock_threshold times in a row; after that the secondary queue
+ * is flushed into the primary queue regardless.
+ *
+ * For more details, see https://arxiv.org/abs/1810.05600.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	int			numa_node;
+	u32			encoded_tail;	/* self */
+	u32			intra_count;	/* consecutive local handoffs */
+};
+
+static unsigned int numa_spinlock_threshold __ro_after_init = 1 << 16;
+
+static void __init cna_init_nodes_per_cpu(unsigned int cpu)
+{
+	struct mcs_spinlock *base = per_cpu_ptr(&qnodes[0].mcs, cpu);
+	int numa_node = cpu_to_node(cpu);
+	int i;
+
+	for (i = 0; i < MAX_NODES; i++) {
+		struct cna_node *cn = (struct cna_node *)grab_mcs_node(base, i);
+
+		cn->numa_node = numa_node;
+		cn->encoded_tail = encode_tail(cpu, i);
+		/*
+		 * @encoded_tail must not be confused with the other valid
+		 * values of @locked (0 or 1).
+		 */
+		WARN_ON(cn->encoded_tail <= 1);
+	}
+}
+
+static void __init cna_init_nodes(void)
+{
+	unsigned int cpu;
+
+	/*
+	 * In CNA, we rely on the assumption that the padding in struct qnode
+	 * is large enough to hold struct cna_node.
+	 */
+	BUILD_BUG_ON(sizeof(struct cna_node) > sizeof(struct qnode));
+
+	for_each_possible_cpu(cpu)
+		cna_init_nodes_per_cpu(cpu);
+}
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node)
+{
+	((struct cna_node *)node)->intra_count = 0;
+}
+
+/*
+ * cna_splice_tail -- splice the nodes in the primary queue between [first,
+ * last] onto the secondary queue.
+ */
+static void cna_splice_tail(struct mcs_spinlock *node,
+			    struct mcs_spinlock *first,
+			    struct mcs_spinlock *last)
+{
+	/* remove [first,last] */
+	node->next = last->next;
+
+	/* stick [first,last] on the secondary queue tail */
+	if (node->locked <= 1) { /* if secondary queue is empty */
+		/* create secondary queue */
+		last->next = first;
+	} else {
+		/* add to the tail of the secondary queue */
+		struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+		struct mcs_spinlock *head_2nd = tail_2nd->next;
+
+		tail_2nd->next = first;
+		last->next = head_2nd;
+	}
+
+	node->locked = ((struct cna_node *)last)->encoded_tail;
+}
+
+/*
+ * cna_order_queue - find the first waiter in the primary queue that runs on
+ * the same NUMA node as the lock holder, moving the waiters in front of it to
+ * the secondary queue. Returns that waiter, or NULL if there is none.
+ *
+ * Only waiters that are already linked are considered; the queue tail is
+ * never moved, so concurrent enqueuers are not disturbed.
+ */
+static struct mcs_spinlock *cna_order_queue(struct mcs_spinlock *node,
+					    struct mcs_spinlock *next)
+{
+	int my_numa_node = ((struct cna_node *)node)->numa_node;
+	struct mcs_spinlock *last = NULL, *cur = next;
+
+	while (cur) {
+		if (((struct cna_node *)cur)->numa_node == my_numa_node) {
+			if (last) {
+				cna_splice_tail(node, next, last);
+				lockevent_inc(cna_reorder);
+			}
+			return cur;
+		}
+		last = cur;
+		cur = READ_ONCE(cur->next);
+	}
+
+	return NULL;
+}
+
+/*
+ * cna_try_clear_tail - called when the lock holder is the last waiter in the
+ * primary queue. With an empty secondary queue this is the plain MCS
+ * release; otherwise the secondary queue becomes the primary one.
+ */
+static inline bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+				      struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *head_2nd, *tail_2nd;
+	u32 new;
+
+	/* If the secondary queue is empty, do what MCS does. */
+	if (node->locked <= 1)
+		return atomic_try_cmpxchg_relaxed(&lock->val, &val,
+						  _Q_LOCKED_VAL);
+
+	/*
+	 * Try to update the tail value to the last node in the secondary
+	 * queue. If successful, pass the lock to the first thread in the
+	 * secondary queue. Doing those two actions effectively moves all
+	 * nodes from the secondary queue into the primary one.
+	 */
+	tail_2nd = decode_tail(node->locked);
+	head_2nd = tail_2nd->next;
+	new = ((struct cna_node *)tail_2nd)->encoded_tail + _Q_LOCKED_VAL;
+
+	if (atomic_try_cmpxchg_relaxed(&lock->val, &val, new)) {
+		/*
+		 * Try to reset @next in tail_2nd to NULL, but no need to check
+		 * the result - if failed, a new successor has updated it.
+		 */
+		cmpxchg_relaxed(&tail_2nd->next, head_2nd, NULL);
+		arch_mcs_spin_unlock_contended(&head_2nd->locked);
+		lockevent_inc(cna_flush);
+		return true;
+	}
+
+	return false;
+}
+
+static inline void cna_lock_handoff(struct mcs_spinlock *node,
+				    struct mcs_spinlock *next)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	struct mcs_spinlock *local = NULL;
+	u32 val = 1;
+
+	if (cn->intra_count < numa_spinlock_threshold)
+		local = cna_order_queue(node, next);
+
+	if (local) {
+		/*
+		 * Pass the lock within the node, handing the secondary queue
+		 * (if any) over together with it.
+		 */
+		((struct cna_node *)local)->intra_count = cn->intra_count + 1;
+		if (node->locked > 1)
+			val = node->locked;
+		next = local;
+	} else if (node->locked > 1) {
+		/*
+		 * No local waiter, or we passed the lock locally for too
+		 * long: put the secondary queue in front of the primary one.
+		 */
+		struct mcs_spinlock *tail_2nd = decode_tail(node->locked);
+		struct mcs_spinlock *head_2nd = tail_2nd->next;
+
+		tail_2nd->next = next;
+		next = head_2nd;
+		lockevent_inc(cna_flush);
+	}
+
+	if (((struct cna_node *)next)->numa_node == cn->numa_node)
+		lockevent_inc(cna_intra_node);
+	else
+		lockevent_inc(cna_inter_node);
+
+	/* pairs with arch_mcs_spin_lock_contended() in the successor */
+	smp_store_release(&next->locked, val);
+}
+
+/*
+ * Switch to the NUMA-friendly slow path for spinlocks when there are multiple
+ * NUMA nodes, unless the user has overridden this with numa_spinlock=.
+ */
+static int numa_spinlock_flag;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto")) {
+		numa_spinlock_flag = 0;
+		return 1;
+	} else if (!strcmp(str, "on")) {
+		numa_spinlock_flag = 1;
+		return 1;
+	} else if (!strcmp(str, "off")) {
+		numa_spinlock_flag = -1;
+		return 1;
+	}
+
+	return 0;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	return !kstrtouint(str, 0, &numa_spinlock_threshold);
+}
+__setup("numa_spinlock_threshold=", numa_spinlock_threshold_setup);
+
+/*
+ * Waiters queued by the plain MCS slowpath do not know about the secondary
+ * queue, so the switch must happen while only the boot CPU is running.
+ */
+static int __init cna_configure_spin_lock_slowpath(void)
+{
+	if (numa_spinlock_flag < 0)
+		return 0;
+
+	if (numa_spinlock_flag == 0 && nr_node_ids < 2)
+		return 0;
+
+	cna_init_nodes();
+	WRITE_ONCE(numa_spinlock_enabled, true);
+
+	pr_info("Enabling CNA spinlock\n");
+
+	return 0;
+}
+early_initcall(cna_configure_spin_lock_slowpath);
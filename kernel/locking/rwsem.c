@@ -29,6 +29,7 @@
 #include <linux/atomic.h>
 
 #include "lock_events.h"
+#include "lock_contention.h"
 
 /*
  * The least significant 3 bits of the owner value has the following
@@ -1338,8 +1339,12 @@ static struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem)
 static inline void __down_read(struct rw_semaphore *sem)
 {
 	if (!rwsem_read_trylock(sem)) {
+		u64 wait_start = lock_contention_begin();
+
 		rwsem_down_read_slowpath(sem, TASK_UNINTERRUPTIBLE);
 		DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
+		lock_contention_end(sem, LOCK_CONTENTION_RWSEM_READ,
+				    wait_start, _RET_IP_);
 	} else {
 		rwsem_set_reader_owned(sem);
 	}
@@ -1348,9 +1353,13 @@ static inline void __down_read(struct rw_semaphore *sem)
 static inline int __down_read_killable(struct rw_semaphore *sem)
 {
 	if (!rwsem_read_trylock(sem)) {
+		u64 wait_start = lock_contention_begin();
+
 		if (IS_ERR(rwsem_down_read_slowpath(sem, TASK_KILLABLE)))
 			return -EINTR;
 		DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
+		lock_contention_end(sem, LOCK_CONTENTION_RWSEM_READ,
+				    wait_start, _RET_IP_);
 	} else {
 		rwsem_set_reader_owned(sem);
 	}
@@ -1385,10 +1394,15 @@ static inline void __down_write(struct rw_semaphore *sem)
 	long tmp = RWSEM_UNLOCKED_VALUE;
 
 	if (unlikely(!atomic_long_try_cmpxchg_acquire(&sem->count, &tmp,
-						      RWSEM_WRITER_LOCKED)))
+						      RWSEM_WRITER_LOCKED))) {
+		u64 wait_start = lock_contention_begin();
+
 		rwsem_down_write_slowpath(sem, TASK_UNINTERRUPTIBLE);
-	else
+		lock_contention_end(sem, LOCK_CONTENTION_RWSEM_WRITE,
+				    wait_start, _RET_IP_);
+	} else {
 		rwsem_set_owner(sem);
+	}
 }
 
 static inline int __down_write_killable(struct rw_semaphore *sem)
@@ -1397,8 +1411,12 @@ static inline int __down_write_killable(struct rw_semaphore *sem)
 
 	if (unlikely(!atomic_long_try_cmpxchg_acquire(&sem->count, &tmp,
 						      RWSEM_WRITER_LOCKED))) {
+		u64 wait_start = lock_contention_begin();
+
 		if (IS_ERR(rwsem_down_write_slowpath(sem, TASK_KILLABLE)))
 			return -EINTR;
+		lock_contention_end(sem, LOCK_CONTENTION_RWSEM_WRITE,
+				    wait_start, _RET_IP_);
 	} else {
 		rwsem_set_owner(sem);
 	}
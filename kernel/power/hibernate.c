@@ -31,6 +31,7 @@
 #include <linux/genhd.h>
 #include <linux/ktime.h>
 #include <linux/security.h>
+#include <linux/crypto.h>
 #include <trace/events/power.h>
 
 #include "power.h"
@@ -46,6 +47,18 @@ dev_t swsusp_resume_device;
 sector_t swsusp_resume_block;
 __visible int in_suspend __nosavedata;
 
+static const struct {
+	const char *name;
+	unsigned int flags;
+} hib_compressors[] = {
+	{ "lzo", SF_COMPRESSION_ALG_LZO },
+	{ "lz4", SF_COMPRESSION_ALG_LZ4 },
+	{ "zstd", SF_COMPRESSION_ALG_ZSTD },
+};
+
+unsigned int hib_comp_flags;
+unsigned int hib_comp_threads = 3;
+
 enum {
 	HIBERNATION_INVALID,
 	HIBERNATION_PLATFORM,
@@ -741,7 +754,7 @@ int hibernate(void)
 		if (nocompress)
 			flags |= SF_NOCOMPRESS_MODE;
 		else
-		        flags |= SF_CRC32_MODE;
+			flags |= SF_CRC32_MODE | hib_comp_flags;
 
 		pm_pr_dbg("Writing hibernation image.\n");
 		error = swsusp_write(flags);
@@ -1150,12 +1163,112 @@ static ssize_t reserved_size_store(struct kobject *kobj,
 
 power_attr(reserved_size);
 
+/**
+ * hib_comp_name - Return the name of the compressor selected by @flags.
+ * @flags: Image header flags.
+ */
+const char *hib_comp_name(unsigned int flags)
+{
+	int i;
+
+	flags &= SF_COMPRESSION_ALG_MASK;
+	for (i = 0; i < ARRAY_SIZE(hib_compressors); i++)
+		if (hib_compressors[i].flags == flags)
+			return hib_compressors[i].name;
+
+	return NULL;
+}
+
+static int hib_comp_lookup(const char *buf, size_t n)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(hib_compressors); i++)
+		if (n == strlen(hib_compressors[i].name) &&
+		    !strncmp(buf, hib_compressors[i].name, n))
+			return i;
+
+	return -EINVAL;
+}
+
+static ssize_t compressor_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	char *start = buf;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(hib_compressors); i++) {
+		if (!crypto_has_comp(hib_compressors[i].name, 0, 0))
+			continue;
+		if (hib_compressors[i].flags == hib_comp_flags)
+			buf += sprintf(buf, "[%s] ", hib_compressors[i].name);
+		else
+			buf += sprintf(buf, "%s ", hib_compressors[i].name);
+	}
+	buf += sprintf(buf, "\n");
+	return buf-start;
+}
+
+static ssize_t compressor_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t n)
+{
+	char *p;
+	int i;
+
+	p = memchr(buf, '\n', n);
+	i = hib_comp_lookup(buf, p ? p - buf : n);
+	if (i < 0)
+		return i;
+
+	if (!crypto_has_comp(hib_compressors[i].name, 0, 0))
+		return -EOPNOTSUPP;
+
+	lock_system_sleep();
+	hib_comp_flags = hib_compressors[i].flags;
+	unlock_system_sleep();
+	pm_pr_dbg("Hibernation compressor set to '%s'\n",
+		  hib_compressors[i].name);
+	return n;
+}
+
+power_attr(compressor);
+
+static ssize_t compression_threads_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", hib_comp_threads);
+}
+
+static ssize_t compression_threads_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t n)
+{
+	unsigned int val;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &val);
+	if (rc)
+		return rc;
+	if (!val)
+		return -EINVAL;
+
+	lock_system_sleep();
+	hib_comp_threads = val;
+	unlock_system_sleep();
+	return n;
+}
+
+power_attr(compression_threads);
+
 static struct attribute * g[] = {
 	&disk_attr.attr,
 	&resume_offset_attr.attr,
 	&resume_attr.attr,
 	&image_size_attr.attr,
 	&reserved_size_attr.attr,
+	&compressor_attr.attr,
+	&compression_threads_attr.attr,
 	NULL,
 };
 
@@ -1167,6 +1280,12 @@ static const struct attribute_group attr_group = {
 
 static int __init pm_disk_init(void)
 {
+	const char *def = CONFIG_HIBERNATION_DEF_COMP;
+	int i = hib_comp_lookup(def, strlen(def));
+
+	if (i >= 0)
+		hib_comp_flags = hib_compressors[i].flags;
+
 	return sysfs_create_group(power_kobj, &attr_group);
 }
 
@@ -169,6 +169,18 @@ extern int swsusp_swap_in_use(void);
 #define SF_NOCOMPRESS_MODE	2
 #define SF_CRC32_MODE	        4
 
+/* Compressor used for the image, LZO if none of the bits is set. */
+#define SF_COMPRESSION_ALG_LZO	0
+#define SF_COMPRESSION_ALG_LZ4	8
+#define SF_COMPRESSION_ALG_ZSTD	16
+#define SF_COMPRESSION_ALG_MASK	(SF_COMPRESSION_ALG_LZ4 | \
+				 SF_COMPRESSION_ALG_ZSTD)
+
+/* Compressor and maximum number of threads for compressed images */
+extern unsigned int hib_comp_flags;
+extern unsigned int hib_comp_threads;
+extern const char *hib_comp_name(unsigned int flags);
+
 /* kernel/power/hibernate.c */
 extern int swsusp_check(void);
 extern void swsusp_free(void);
@@ -899,6 +899,42 @@ static unsigned long memory_bm_next_pfn(struct memory_bitmap *bm)
 	return BM_END_OF_MAP;
 }
 
+/**
+ * memory_bm_next_clear_pfn - Find the next clear bit in a memory bitmap.
+ * @bm: Memory bitmap.
+ * @pfn: PFN to start the search from.
+ * @end_pfn: PFN to stop the search at.
+ *
+ * Return the first PFN in [@pfn, @end_pfn) whose bit in @bm is clear, or
+ * @end_pfn if there is none.  Set bits are skipped a bitmap word at a time.
+ * PFNs not covered by @bm are treated as clear.
+ */
+static unsigned long memory_bm_next_clear_pfn(struct memory_bitmap *bm,
+					      unsigned long pfn,
+					      unsigned long end_pfn)
+{
+	unsigned long bits, next;
+	unsigned int bit;
+	void *addr;
+
+	while (pfn < end_pfn) {
+		if (memory_bm_find_bit(bm, pfn, &addr, &bit))
+			return pfn;
+
+		bits = bm->cur.zone->end_pfn - bm->cur.zone->start_pfn -
+		       bm->cur.node_pfn;
+		bits = min_t(unsigned long, bits, BM_BITS_PER_BLOCK);
+		bits = min(bits, bit + (end_pfn - pfn));
+
+		next = find_next_zero_bit(addr, bits, bit);
+		pfn += next - bit;
+		if (next < bits)
+			return pfn;
+	}
+
+	return end_pfn;
+}
+
 /*
  * This structure represents a range of page frames the contents of which
  * should not be saved during hibernation.
@@ -1009,6 +1045,21 @@ static int swsusp_page_is_free(struct page *page)
 		memory_bm_test_bit(free_pages_map, page_to_pfn(page)) : 0;
 }
 
+/*
+ * Return the first PFN in [@pfn, @end_pfn) that is not marked as free, or
+ * @end_pfn.  Free and image page frames are never saved, so the scans below
+ * use this to step over their runs without looking at every struct page.
+ */
+static unsigned long next_nonfree_pfn(unsigned long pfn, unsigned long end_pfn)
+{
+	return free_pages_map ?
+		memory_bm_next_clear_pfn(free_pages_map, pfn, end_pfn) : pfn;
+}
+
+#define for_each_nonfree_pfn(pfn, start_pfn, end_pfn)			\
+	for (pfn = next_nonfree_pfn(start_pfn, end_pfn); pfn < (end_pfn); \
+	     pfn = next_nonfree_pfn(pfn + 1, end_pfn))
+
 void swsusp_unset_page_free(struct page *page)
 {
 	if (free_pages_map)
@@ -1257,7 +1308,7 @@ static unsigned int count_highmem_pages(void)
 
 		mark_free_pages(zone);
 		max_zone_pfn = zone_end_pfn(zone);
-		for (pfn = zone->zone_start_pfn; pfn < max_zone_pfn; pfn++)
+		for_each_nonfree_pfn(pfn, zone->zone_start_pfn, max_zone_pfn)
 			if (saveable_highmem_page(zone, pfn))
 				n++;
 	}
@@ -1324,7 +1375,7 @@ static unsigned int count_data_pages(void)
 
 		mark_free_pages(zone);
 		max_zone_pfn = zone_end_pfn(zone);
-		for (pfn = zone->zone_start_pfn; pfn < max_zone_pfn; pfn++)
+		for_each_nonfree_pfn(pfn, zone->zone_start_pfn, max_zone_pfn)
 			if (saveable_page(zone, pfn))
 				n++;
 	}
@@ -1418,7 +1469,7 @@ static void copy_data_pages(struct memory_bitmap *copy_bm,
 
 		mark_free_pages(zone);
 		max_zone_pfn = zone_end_pfn(zone);
-		for (pfn = zone->zone_start_pfn; pfn < max_zone_pfn; pfn++)
+		for_each_nonfree_pfn(pfn, zone->zone_start_pfn, max_zone_pfn)
 			if (page_is_saveable(zone, pfn))
 				memory_bm_set_bit(orig_bm, pfn);
 	}
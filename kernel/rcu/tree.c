@@ -55,6 +55,7 @@
 #include <linux/smpboot.h>
 #include <linux/jiffies.h>
 #include <linux/slab.h>
+#include <linux/shrinker.h>
 #include <linux/sched/isolation.h>
 #include <linux/sched/clock.h>
 #include "../time/tick-internal.h"
@@ -2645,7 +2646,7 @@ static void check_cb_ovld(struct rcu_data *rdp)
 
 /* Helper function for call_rcu() and friends.  */
 static void
-__call_rcu(struct rcu_head *head, rcu_callback_t func)
+__call_rcu(struct rcu_head *head, rcu_callback_t func, bool lazy)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -2682,7 +2683,7 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func)
 	}
 
 	check_cb_ovld(rdp);
-	if (rcu_nocb_try_bypass(rdp, head, &was_alldone, flags))
+	if (rcu_nocb_try_bypass(rdp, head, &was_alldone, flags, lazy))
 		return; // Enqueued onto ->nocb_bypass, so just leave.
 	// If no-CBs CPU gets here, rcu_nocb_try_bypass() acquired ->nocb_lock.
 	rcu_segcblist_enqueue(&rdp->cblist, head);
@@ -2741,10 +2742,32 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func)
  */
 void call_rcu(struct rcu_head *head, rcu_callback_t func)
 {
-	__call_rcu(head, func);
+	__call_rcu(head, func, false);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
+#ifdef CONFIG_RCU_LAZY
+/**
+ * call_rcu_lazy() - Queue a non-urgent RCU callback.
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Like call_rcu(), but on no-CBs CPUs the callback may be held back in
+ * the ->nocb_bypass list for up to rcutree.jiffies_lazy_flush jiffies
+ * (or until enough of them pile up, or the system runs short of memory)
+ * so that many such callbacks share a single grace period instead of
+ * each one waking up the grace-period machinery.  Use this only for
+ * callbacks that merely free memory and whose latency does not matter.
+ *
+ * The memory-ordering guarantees are the same as those of call_rcu().
+ */
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	__call_rcu(head, func, true);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+#endif
+
 
 /* Maximum number of jiffies to wait before draining a batch. */
 #define KFREE_DRAIN_JIFFIES (HZ / 50)
@@ -3296,12 +3319,22 @@ static void rcu_barrier_func(void *cpu_in)
 {
 	uintptr_t cpu = (uintptr_t)cpu_in;
 	struct rcu_data *rdp = per_cpu_ptr(&rcu_data, cpu);
+	unsigned long flags;
+	bool was_alldone;
+	bool wake_nocb;
 
 	rcu_barrier_trace(TPS("IRQ"), -1, rcu_state.barrier_sequence);
 	rdp->barrier_head.func = rcu_barrier_callback;
 	debug_rcu_head_queue(&rdp->barrier_head);
 	rcu_nocb_lock(rdp);
+	was_alldone = !rcu_segcblist_pend_cbs(&rdp->cblist);
 	WARN_ON_ONCE(!rcu_nocb_flush_bypass(rdp, NULL, jiffies));
+	/*
+	 * Lazy callbacks just flushed onto an otherwise idle ->cblist have
+	 * no one to request a grace period for them any time soon.
+	 */
+	wake_nocb = was_alldone && rcu_segcblist_is_offloaded(&rdp->cblist) &&
+		    rcu_segcblist_pend_cbs(&rdp->cblist);
 	if (rcu_segcblist_entrain(&rdp->cblist, &rdp->barrier_head)) {
 		atomic_inc(&rcu_state.barrier_cpu_count);
 	} else {
@@ -3309,7 +3342,12 @@ static void rcu_barrier_func(void *cpu_in)
 		rcu_barrier_trace(TPS("IRQNQ"), -1,
 				  rcu_state.barrier_sequence);
 	}
-	rcu_nocb_unlock(rdp);
+	if (wake_nocb) {
+		local_save_flags(flags); /* irqs already disabled. */
+		__call_rcu_nocb_wake(rdp, true, flags);
+	} else {
+		rcu_nocb_unlock(rdp);
+	}
 }
 
 /**
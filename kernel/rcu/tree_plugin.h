@@ -1482,6 +1482,14 @@ early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 int nocb_nobypass_lim_per_jiffy = 16 * 1000 / HZ;
 module_param(nocb_nobypass_lim_per_jiffy, int, 0);
 
+/*
+ * How long a ->nocb_bypass list holding only call_rcu_lazy() callbacks may
+ * be left alone before its callbacks are handed to the grace-period
+ * machinery.  Memory pressure and qhimark cut this short.
+ */
+static unsigned long jiffies_lazy_flush = 10 * HZ;
+module_param(jiffies_lazy_flush, ulong, 0644);
+
 /*
  * Acquire the specified rcu_data structure's ->nocb_bypass_lock.  If the
  * lock isn't immediately available, increment ->nocb_lock_contended to
@@ -1684,6 +1692,7 @@ static bool rcu_nocb_do_flush_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
 	rcu_cblist_flush_enqueue(&rcl, &rdp->nocb_bypass, rhp);
 	rcu_segcblist_insert_pend_cbs(&rdp->cblist, &rcl);
 	WRITE_ONCE(rdp->nocb_bypass_first, j);
+	WRITE_ONCE(rdp->lazy_len, 0);
 	rcu_nocb_bypass_unlock(rdp);
 	return true;
 }
@@ -1719,6 +1728,31 @@ static void rcu_nocb_try_flush_bypass(struct rcu_data *rdp, unsigned long j)
 	WARN_ON_ONCE(!rcu_nocb_do_flush_bypass(rdp, NULL, j));
 }
 
+/*
+ * Does ->nocb_bypass hold nothing but call_rcu_lazy() callbacks?  If so,
+ * it need not be flushed until jiffies_lazy_flush after its first enqueue.
+ */
+static bool rcu_nocb_bypass_is_lazy(struct rcu_data *rdp, long ncbs)
+{
+	return ncbs && ncbs == READ_ONCE(rdp->lazy_len);
+}
+
+/*
+ * Make sure that the no-CBs GP kthread looks at a lazy ->nocb_bypass by
+ * its flush deadline, but without waking it up any earlier than that.
+ */
+static void rcu_nocb_lazy_timer(struct rcu_data *rdp, unsigned long j)
+{
+	unsigned long flags;
+	struct rcu_data *rdp_gp = rdp->nocb_gp_rdp;
+
+	if (rcu_nocb_poll)
+		return;
+	raw_spin_lock_irqsave(&rdp_gp->nocb_gp_lock, flags);
+	timer_reduce(&rdp_gp->nocb_bypass_timer, j + jiffies_lazy_flush);
+	raw_spin_unlock_irqrestore(&rdp_gp->nocb_gp_lock, flags);
+}
+
 /*
  * See whether it is appropriate to use the ->nocb_bypass list in order
  * to control contention on ->nocb_lock.  A limited number of direct
@@ -1732,18 +1766,25 @@ static void rcu_nocb_try_flush_bypass(struct rcu_data *rdp, unsigned long j)
  * non-empty, the corresponding no-CBs grace-period kthread must not be
  * in an indefinite sleep state.
  *
+ * Lazy callbacks always go to ->nocb_bypass, whatever the call_rcu()
+ * rate, so that they can be batched up.  A bypass list containing only
+ * lazy callbacks does not wake the GP kthread at all; instead its bypass
+ * timer is pulled in to the lazy flush deadline.
+ *
  * Finally, it is not permitted to use the bypass during early boot,
  * as doing so would confuse the auto-initialization code.  Besides
  * which, there is no point in worrying about lock contention while
  * there is only one CPU in operation.
  */
 static bool rcu_nocb_try_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
-				bool *was_alldone, unsigned long flags)
+				bool *was_alldone, unsigned long flags,
+				bool lazy)
 {
 	unsigned long c;
 	unsigned long cur_gp_seq;
 	unsigned long j = jiffies;
 	long ncbs = rcu_cblist_n_cbs(&rdp->nocb_bypass);
+	bool bypass_is_lazy = rcu_nocb_bypass_is_lazy(rdp, ncbs);
 
 	if (!rcu_segcblist_is_offloaded(&rdp->cblist)) {
 		*was_alldone = !rcu_segcblist_pend_cbs(&rdp->cblist);
@@ -1776,8 +1817,8 @@ static bool rcu_nocb_try_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
 
 	// If there hasn't yet been all that many ->cblist enqueues
 	// this jiffy, tell the caller to enqueue onto ->cblist.  But flush
-	// ->nocb_bypass first.
-	if (rdp->nocb_nobypass_count < nocb_nobypass_lim_per_jiffy) {
+	// ->nocb_bypass first.  Lazy callbacks are batched regardless.
+	if (!lazy && rdp->nocb_nobypass_count < nocb_nobypass_lim_per_jiffy) {
 		rcu_nocb_lock(rdp);
 		*was_alldone = !rcu_segcblist_pend_cbs(&rdp->cblist);
 		if (*was_alldone)
@@ -1789,8 +1830,13 @@ static bool rcu_nocb_try_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
 	}
 
 	// If ->nocb_bypass has been used too long or is too full,
-	// flush ->nocb_bypass to ->cblist.
-	if ((ncbs && j != READ_ONCE(rdp->nocb_bypass_first)) ||
+	// flush ->nocb_bypass to ->cblist.  "Too long" is much longer
+	// when it holds only lazy callbacks.
+	if ((ncbs && !bypass_is_lazy &&
+	     j != READ_ONCE(rdp->nocb_bypass_first)) ||
+	    (bypass_is_lazy &&
+	     time_after(j, READ_ONCE(rdp->nocb_bypass_first) +
+			   jiffies_lazy_flush)) ||
 	    ncbs >= qhimark) {
 		rcu_nocb_lock(rdp);
 		if (!rcu_nocb_flush_bypass(rdp, rhp, j)) {
@@ -1817,16 +1863,27 @@ static bool rcu_nocb_try_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
 	ncbs = rcu_cblist_n_cbs(&rdp->nocb_bypass);
 	rcu_segcblist_inc_len(&rdp->cblist); /* Must precede enqueue. */
 	rcu_cblist_enqueue(&rdp->nocb_bypass, rhp);
+	if (lazy) {
+		WRITE_ONCE(rdp->lazy_len, rdp->lazy_len + 1);
+		WRITE_ONCE(rdp->n_lazy_cbs, rdp->n_lazy_cbs + 1);
+	}
 	if (!ncbs) {
 		WRITE_ONCE(rdp->nocb_bypass_first, j);
 		trace_rcu_nocb_wake(rcu_state.name, rdp->cpu, TPS("FirstBQ"));
 	}
 	rcu_nocb_bypass_unlock(rdp);
 	smp_mb(); /* Order enqueue before wake. */
-	if (ncbs) {
+	if (ncbs && (!bypass_is_lazy || lazy)) {
 		local_irq_restore(flags);
+	} else if (lazy) {
+		// First lazy CB, so just make sure that it is not stranded.
+		trace_rcu_nocb_wake(rcu_state.name, rdp->cpu,
+				    TPS("FirstLazyBQ"));
+		local_irq_restore(flags);
+		rcu_nocb_lazy_timer(rdp, j);
 	} else {
-		// No-CBs GP kthread might be indefinitely asleep, if so, wake.
+		// No-CBs GP kthread might be indefinitely asleep, or only
+		// waiting for a lazy flush deadline.  If so, wake.
 		rcu_nocb_lock(rdp); // Rare during call_rcu() flood.
 		if (!rcu_segcblist_pend_cbs(&rdp->cblist)) {
 			trace_rcu_nocb_wake(rcu_state.name, rdp->cpu,
@@ -1922,11 +1979,15 @@ static void nocb_gp_wait(struct rcu_data *my_rdp)
 {
 	bool bypass = false;
 	long bypass_ncbs;
+	bool bypass_is_lazy;
+	unsigned long c;
 	int __maybe_unused cpu = my_rdp->cpu;
 	unsigned long cur_gp_seq;
 	unsigned long flags;
 	bool gotcbs = false;
 	unsigned long j = jiffies;
+	bool lazy = false;
+	unsigned long lazy_deadline = 0;
 	bool needwait_gp = false; // This prevents actual uninitialized use.
 	bool needwake;
 	bool needwake_gp;
@@ -1944,17 +2005,30 @@ static void nocb_gp_wait(struct rcu_data *my_rdp)
 		trace_rcu_nocb_wake(rcu_state.name, rdp->cpu, TPS("Check"));
 		rcu_nocb_lock_irqsave(rdp, flags);
 		bypass_ncbs = rcu_cblist_n_cbs(&rdp->nocb_bypass);
+		bypass_is_lazy = rcu_nocb_bypass_is_lazy(rdp, bypass_ncbs);
 		if (bypass_ncbs &&
-		    (time_after(j, READ_ONCE(rdp->nocb_bypass_first) + 1) ||
+		    (time_after(j, READ_ONCE(rdp->nocb_bypass_first) +
+				   (bypass_is_lazy ? jiffies_lazy_flush : 1)) ||
 		     bypass_ncbs > 2 * qhimark)) {
 			// Bypass full or old, so flush it.
 			(void)rcu_nocb_try_flush_bypass(rdp, j);
 			bypass_ncbs = rcu_cblist_n_cbs(&rdp->nocb_bypass);
+			bypass_is_lazy = rcu_nocb_bypass_is_lazy(rdp,
+								 bypass_ncbs);
 		} else if (!bypass_ncbs && rcu_segcblist_empty(&rdp->cblist)) {
 			rcu_nocb_unlock_irqrestore(rdp, flags);
 			continue; /* No callbacks here, try next. */
 		}
-		if (bypass_ncbs) {
+		if (bypass_is_lazy) {
+			// Only lazy CBs, so just come back by their deadline.
+			trace_rcu_nocb_wake(rcu_state.name, rdp->cpu,
+					    TPS("LazyBypass"));
+			c = READ_ONCE(rdp->nocb_bypass_first) +
+			    jiffies_lazy_flush;
+			if (!lazy || time_before(c, lazy_deadline))
+				lazy_deadline = c;
+			lazy = true;
+		} else if (bypass_ncbs) {
 			trace_rcu_nocb_wake(rcu_state.name, rdp->cpu,
 					    TPS("Bypass"));
 			bypass = true;
@@ -2014,6 +2088,13 @@ static void nocb_gp_wait(struct rcu_data *my_rdp)
 		raw_spin_lock_irqsave(&my_rdp->nocb_gp_lock, flags);
 		mod_timer(&my_rdp->nocb_bypass_timer, j + 2);
 		raw_spin_unlock_irqrestore(&my_rdp->nocb_gp_lock, flags);
+	} else if (lazy && !rcu_nocb_poll) {
+		// Only lazy ->nocb_bypass lists, so sleep until the
+		// earliest of their flush deadlines.
+		raw_spin_lock_irqsave(&my_rdp->nocb_gp_lock, flags);
+		mod_timer(&my_rdp->nocb_bypass_timer,
+			  time_after(lazy_deadline, j) ? lazy_deadline : j + 1);
+		raw_spin_unlock_irqrestore(&my_rdp->nocb_gp_lock, flags);
 	}
 	if (rcu_nocb_poll) {
 		/* Polling, so trace if first poll in the series. */
@@ -2037,7 +2118,7 @@ static void nocb_gp_wait(struct rcu_data *my_rdp)
 	}
 	if (!rcu_nocb_poll) {
 		raw_spin_lock_irqsave(&my_rdp->nocb_gp_lock, flags);
-		if (bypass)
+		if (bypass || lazy)
 			del_timer(&my_rdp->nocb_bypass_timer);
 		WRITE_ONCE(my_rdp->nocb_gp_sleep, true);
 		raw_spin_unlock_irqrestore(&my_rdp->nocb_gp_lock, flags);
@@ -2279,6 +2360,71 @@ static void rcu_spawn_cpu_nocb_kthread(int cpu)
 		rcu_spawn_one_nocb_kthread(cpu);
 }
 
+#ifdef CONFIG_RCU_LAZY
+/*
+ * Lazy callbacks typically free memory, so when memory runs short, push
+ * them towards a grace period instead of waiting out jiffies_lazy_flush.
+ */
+static unsigned long
+lazy_rcu_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long count = 0;
+
+	for_each_cpu(cpu, rcu_nocb_mask)
+		count += READ_ONCE(per_cpu_ptr(&rcu_data, cpu)->lazy_len);
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long
+lazy_rcu_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long flags;
+	unsigned long count = 0;
+	long lazy_len;
+	struct rcu_data *rdp;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(&rcu_data, cpu);
+		if (!READ_ONCE(rdp->lazy_len))
+			continue;
+		rcu_nocb_lock_irqsave(rdp, flags);
+		lazy_len = READ_ONCE(rdp->lazy_len);
+		if (!lazy_len || !rcu_segcblist_is_offloaded(&rdp->cblist)) {
+			rcu_nocb_unlock_irqrestore(rdp, flags);
+			continue;
+		}
+		WARN_ON_ONCE(!rcu_nocb_flush_bypass(rdp, NULL, jiffies));
+		WRITE_ONCE(rdp->n_lazy_shrink, rdp->n_lazy_shrink + 1);
+		wake_nocb_gp(rdp, false, flags);
+		count += lazy_len;
+		if (count >= sc->nr_to_scan)
+			break;
+	}
+	return count ? count : SHRINK_STOP;
+}
+
+static struct shrinker lazy_rcu_shrinker = {
+	.count_objects = lazy_rcu_shrink_count,
+	.scan_objects = lazy_rcu_shrink_scan,
+	.batch = 0,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static void __init rcu_lazy_shrinker_init(void)
+{
+	if (!cpumask_available(rcu_nocb_mask))
+		return;
+	if (register_shrinker(&lazy_rcu_shrinker))
+		pr_err("Failed to register lazy_rcu shrinker!\n");
+}
+#else /* #ifdef CONFIG_RCU_LAZY */
+static void __init rcu_lazy_shrinker_init(void)
+{
+}
+#endif /* #else #ifdef CONFIG_RCU_LAZY */
+
 /*
  * Once the scheduler is running, spawn rcuo kthreads for all online
  * no-CBs CPUs.  This assumes that the early_initcall()s happen before
@@ -2291,6 +2437,7 @@ static void __init rcu_spawn_nocb_kthreads(void)
 
 	for_each_online_cpu(cpu)
 		rcu_spawn_cpu_nocb_kthread(cpu);
+	rcu_lazy_shrinker_init();
 }
 
 /* How many CB CPU IDs per GP kthread?  Default of -1 for sqrt(nr_cpu_ids). */
@@ -2402,7 +2549,7 @@ static void show_rcu_nocb_state(struct rcu_data *rdp)
 	if (rdp->nocb_gp_rdp == rdp)
 		show_rcu_nocb_gp_state(rdp);
 
-	pr_info("   CB %d->%d %c%c%c%c%c%c F%ld L%ld C%d %c%c%c%c%c q%ld\n",
+	pr_info("   CB %d->%d %c%c%c%c%c%c F%ld L%ld C%d %c%c%c%c%c q%ld z%ld/%lu/%lu\n",
 		rdp->cpu, rdp->nocb_gp_rdp->cpu,
 		"kK"[!!rdp->nocb_cb_kthread],
 		"bB"[raw_spin_is_locked(&rdp->nocb_bypass_lock)],
@@ -2418,7 +2565,9 @@ static void show_rcu_nocb_state(struct rcu_data *rdp)
 		".R"[!rcu_segcblist_restempty(rsclp, RCU_WAIT_TAIL)],
 		".N"[!rcu_segcblist_restempty(rsclp, RCU_NEXT_READY_TAIL)],
 		".B"[!!rcu_cblist_n_cbs(&rdp->nocb_bypass)],
-		rcu_segcblist_n_cbs(&rdp->cblist));
+		rcu_segcblist_n_cbs(&rdp->cblist),
+		READ_ONCE(rdp->lazy_len), READ_ONCE(rdp->n_lazy_cbs),
+		READ_ONCE(rdp->n_lazy_shrink));
 
 	/* It is OK for GP kthreads to have GP state. */
 	if (rdp->nocb_gp_rdp == rdp)
@@ -2484,7 +2633,8 @@ static bool rcu_nocb_flush_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
 }
 
 static bool rcu_nocb_try_bypass(struct rcu_data *rdp, struct rcu_head *rhp,
-				bool *was_alldone, unsigned long flags)
+				bool *was_alldone, unsigned long flags,
+				bool lazy)
 {
 	return false;
 }
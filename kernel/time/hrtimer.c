@@ -1137,6 +1137,191 @@ void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 }
 EXPORT_SYMBOL_GPL(hrtimer_start_range_ns);
 
+/*
+ * Round the hard expiry of a bulk armed timer up to the next multiple of
+ * @slack_ns and return the resulting range. Timers whose expiries fall
+ * into the same slack window then share one hard expiry and are expired
+ * by a single interrupt, no matter which batch armed them.
+ */
+static u64 hrtimer_bulk_range(ktime_t tim, u64 slack_ns)
+{
+	ktime_t hard;
+
+	if (!slack_ns || slack_ns > KTIME_MAX || tim < 0 ||
+	    tim > KTIME_MAX - (ktime_t)slack_ns)
+		return 0;
+
+	hard = ktime_divns(tim + slack_ns - 1, slack_ns) * slack_ns;
+	return hard - tim;
+}
+
+static inline ktime_t hrtimer_bulk_expires(struct hrtimer *timer)
+{
+	return ktime_sub(hrtimer_get_expires(timer), timer->base->offset);
+}
+
+/*
+ * Start a bulk armed timer which is not queued on this CPU. A relative
+ * expiry is made absolute first, so it gets the same slack window as the
+ * timers handled under this CPU's base lock.
+ */
+static void hrtimer_start_bulk_remote(struct hrtimer *timer, ktime_t tim,
+				      u64 slack_ns,
+				      const enum hrtimer_mode mode)
+{
+	struct hrtimer_clock_base *base;
+	unsigned long flags;
+
+	base = lock_hrtimer_base(timer, &flags);
+
+	if (mode & HRTIMER_MODE_REL) {
+		tim = ktime_add_safe(tim, base->get_time());
+		/* The padding hrtimer_update_lowres() gives relative timers */
+		if (IS_ENABLED(CONFIG_TIME_LOW_RES))
+			tim = ktime_add_safe(tim, hrtimer_resolution);
+	}
+
+	if (__hrtimer_start_range_ns(timer, tim,
+				     hrtimer_bulk_range(tim, slack_ns),
+				     mode & ~HRTIMER_MODE_REL, base))
+		hrtimer_reprogram(timer, true);
+
+	unlock_hrtimer_base(timer, &flags);
+}
+
+/* Number of timers started under one base lock by hrtimer_start_bulk() */
+#define HRTIMER_BULK_BATCH	BITS_PER_LONG
+
+static void __hrtimer_start_bulk(struct hrtimer **timers, const ktime_t *tims,
+				 unsigned int nr, u64 slack_ns,
+				 const enum hrtimer_mode mode)
+{
+	ktime_t now[HRTIMER_MAX_CLOCK_BASES];
+	struct hrtimer *first[2] = { NULL, NULL };
+	struct hrtimer_clock_base *base;
+	struct hrtimer_cpu_base *cpu_base;
+	unsigned int i, now_valid = 0;
+	unsigned long remote = 0;
+	bool reprogram = false;
+	unsigned long flags;
+	ktime_t tim;
+
+	local_irq_save(flags);
+	cpu_base = this_cpu_ptr(&hrtimer_bases);
+	raw_spin_lock(&cpu_base->lock);
+
+	for (i = 0; i < nr; i++) {
+		struct hrtimer *timer = timers[i];
+
+		if (!IS_ENABLED(CONFIG_PREEMPT_RT))
+			WARN_ON_ONCE(!(mode & HRTIMER_MODE_SOFT) ^
+				     !timer->is_soft);
+		else
+			WARN_ON_ONCE(!(mode & HRTIMER_MODE_HARD) ^
+				     !timer->is_hard);
+
+		/*
+		 * Holding this CPU's base lock keeps a timer queued here from
+		 * moving away, and one queued elsewhere from moving here.
+		 * Once it is dropped that no longer holds, so remember which
+		 * timers are left for hrtimer_start_bulk_remote().
+		 */
+		base = READ_ONCE(timer->base);
+		if (base->cpu_base != cpu_base) {
+			__set_bit(i, &remote);
+			continue;
+		}
+
+		/*
+		 * Don't reprogram for every removal, see the note in
+		 * __remove_hrtimer(). Whether the event has to be
+		 * recomputed is decided once for the batch.
+		 */
+		if (timer->state & HRTIMER_STATE_ENQUEUED) {
+			debug_deactivate(timer);
+			if (timer == cpu_base->next_timer)
+				reprogram = true;
+			__remove_hrtimer(timer, base, timer->state, 0);
+		}
+
+		tim = tims[i];
+		if (mode & HRTIMER_MODE_REL) {
+			if (!(now_valid & (1U << base->index))) {
+				now[base->index] = base->get_time();
+				now_valid |= 1U << base->index;
+			}
+			tim = ktime_add_safe(tim, now[base->index]);
+		}
+		tim = hrtimer_update_lowres(timer, tim, mode);
+		hrtimer_set_expires_range_ns(timer, tim,
+					     hrtimer_bulk_range(tim, slack_ns));
+
+		if (!enqueue_hrtimer(timer, base, mode))
+			continue;
+
+		/* Remember the first new leftmost timer of each kind */
+		if (!first[timer->is_soft] ||
+		    hrtimer_bulk_expires(timer) <
+		    hrtimer_bulk_expires(first[timer->is_soft]))
+			first[timer->is_soft] = timer;
+	}
+
+	if (reprogram && !cpu_base->in_hrtirq)
+		hrtimer_force_reprogram(cpu_base, 1);
+
+	/*
+	 * Handle the earlier of the two first, the later one then finds
+	 * the event programmed early enough already.
+	 */
+	if (first[0] && first[1] &&
+	    hrtimer_bulk_expires(first[1]) < hrtimer_bulk_expires(first[0]))
+		swap(first[0], first[1]);
+	if (first[0])
+		hrtimer_reprogram(first[0], true);
+	if (first[1])
+		hrtimer_reprogram(first[1], true);
+
+	raw_spin_unlock_irqrestore(&cpu_base->lock, flags);
+
+	for_each_set_bit(i, &remote, nr)
+		hrtimer_start_bulk_remote(timers[i], tims[i], slack_ns, mode);
+}
+
+/**
+ * hrtimer_start_bulk - (re)start a batch of hrtimers
+ * @timers:	the timers to be added
+ * @tims:	expiry time of each timer
+ * @nr:		number of timers
+ * @slack_ns:	coalescing granularity, 0 to arm the exact expiry times
+ * @mode:	timer mode for all timers, as for hrtimer_start_range_ns()
+ *
+ * Timers which are queued on the current CPU, or were initialized on it
+ * and never started elsewhere, are removed and requeued under a single
+ * base lock, and the clock event device is reprogrammed at most once for
+ * every HRTIMER_BULK_BATCH of them. They stay on the current CPU as if
+ * HRTIMER_MODE_PINNED was set. Any other timer is started on its own
+ * afterwards, like hrtimer_start_range_ns() does.
+ *
+ * With @slack_ns set, each timer may expire up to the next multiple of
+ * @slack_ns after its expiry time, so that nearby expiries are handled
+ * by the same timer interrupt.
+ */
+void hrtimer_start_bulk(struct hrtimer **timers, const ktime_t *tims,
+			unsigned int nr, u64 slack_ns,
+			const enum hrtimer_mode mode)
+{
+	unsigned int n;
+
+	while (nr) {
+		n = min_t(unsigned int, nr, HRTIMER_BULK_BATCH);
+		__hrtimer_start_bulk(timers, tims, n, slack_ns, mode);
+		timers += n;
+		tims += n;
+		nr -= n;
+	}
+}
+EXPORT_SYMBOL_GPL(hrtimer_start_bulk);
+
 /**
  * hrtimer_try_to_cancel - try to deactivate a timer
  * @timer:	hrtimer to stop
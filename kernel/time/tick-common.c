@@ -96,6 +96,8 @@ static void tick_periodic(int cpu)
 		update_wall_time();
 	}
 
+	/* The periodic tick does not read the clocksource, keep it that way */
+	ktime_cache_update(ktime_get_coarse());
 	update_process_times(user_mode(get_irq_regs()));
 	profile_tick(CPU_PROFILING);
 }
@@ -165,3 +165,18 @@ DECLARE_PER_CPU(struct hrtimer_cpu_base, hrtimer_bases);
 
 extern u64 get_next_timer_interrupt(unsigned long basej, u64 basem);
 void timer_clear_idle(void);
+
+#ifdef CONFIG_TIMER_MIGRATION
+/* No pending global timer in the timer migration hierarchy */
+#define TMIGR_NONE	U64_MAX
+
+extern void timer_expire_remote(unsigned int cpu);
+extern u64 tmigr_cpu_deactivate(u64 nextexp);
+extern void tmigr_cpu_activate(void);
+extern void tmigr_cpu_update_remote(unsigned int cpu, u64 nextexp);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_handle_remote(void);
+#else
+static inline bool tmigr_requires_handle_remote(void) { return false; }
+static inline void tmigr_handle_remote(void) { }
+#endif
@@ -524,6 +524,7 @@ static void tick_nohz_update_jiffies(ktime_t now)
 
 	local_irq_save(flags);
 	tick_do_update_jiffies64(now);
+	ktime_cache_update(now);
 	local_irq_restore(flags);
 
 	touch_softlockup_watchdog_sched();
@@ -1198,8 +1199,10 @@ void tick_nohz_idle_exit(void)
 	if (idle_active)
 		tick_nohz_stop_idle(ts, now);
 
-	if (tick_stopped)
+	if (tick_stopped) {
+		ktime_cache_update(now);
 		__tick_nohz_idle_restart_tick(ts, now);
+	}
 
 	local_irq_enable();
 }
@@ -1216,6 +1219,7 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	dev->next_event = KTIME_MAX;
 
 	tick_sched_do_timer(ts, now);
+	ktime_cache_update(now);
 	tick_sched_handle(ts, regs);
 
 	/* No need to reprogram if we are running tickless  */
@@ -1311,6 +1315,7 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	ktime_t now = ktime_get();
 
 	tick_sched_do_timer(ts, now);
+	ktime_cache_update(now);
 
 	/*
 	 * Do not call, when we are not in irq context and have
@@ -22,6 +22,7 @@
 #include <linux/pvclock_gtod.h>
 #include <linux/compiler.h>
 #include <linux/audit.h>
+#include <linux/u64_stats_sync.h>
 
 #include "tick-internal.h"
 #include "ntp_internal.h"
@@ -764,6 +765,93 @@ ktime_t ktime_get(void)
 }
 EXPORT_SYMBOL_GPL(ktime_get);
 
+/*
+ * Per CPU copy of CLOCK_MONOTONIC for callers which can live with the time
+ * of the last tick and want to avoid the sequence count and, worse, a slow
+ * clocksource read on every call.
+ */
+struct ktime_cache {
+	ktime_t			mono;
+	struct u64_stats_sync	syncp;
+	unsigned long		stamp;	/* jiffies at the last update */
+};
+
+static DEFINE_PER_CPU(struct ktime_cache, ktime_cache);
+
+/*
+ * Called with interrupts disabled by the tick code, which has just read
+ * the time anyway. Never moves the cached time of a CPU backwards.
+ */
+void ktime_cache_update(ktime_t now)
+{
+	struct ktime_cache *kc = this_cpu_ptr(&ktime_cache);
+
+	if (now > kc->mono) {
+		u64_stats_update_begin(&kc->syncp);
+		kc->mono = now;
+		u64_stats_update_end(&kc->syncp);
+	}
+	WRITE_ONCE(kc->stamp, jiffies);
+}
+
+/**
+ * ktime_get_cached_refresh - Read CLOCK_MONOTONIC and update the per CPU cache
+ *
+ * Returns the current time like ktime_get(), for callers which are about to
+ * use ktime_get_cached() repeatedly and need the cache to be current.
+ */
+ktime_t ktime_get_cached_refresh(void)
+{
+	unsigned long flags;
+	ktime_t now;
+
+	local_irq_save(flags);
+	now = ktime_get();
+	ktime_cache_update(now);
+	local_irq_restore(flags);
+
+	return now;
+}
+EXPORT_SYMBOL_GPL(ktime_get_cached_refresh);
+
+/**
+ * ktime_get_cached - Coarse CLOCK_MONOTONIC from the per CPU cache
+ *
+ * Returns the time of the last tick, idle exit or refresh on this CPU. It
+ * never goes backwards on one CPU, but the caches of two CPUs may differ by
+ * up to a tick, so a caller which may migrate must cope with a time which
+ * lies slightly before the one it read earlier. On a CPU whose tick is
+ * stopped, or whose cache missed the last tick, the time is read from the
+ * clocksource instead.
+ */
+ktime_t ktime_get_cached(void)
+{
+	struct ktime_cache *kc;
+	unsigned int start;
+	ktime_t mono;
+
+	preempt_disable_notrace();
+	kc = this_cpu_ptr(&ktime_cache);
+	/*
+	 * The cache is stale before the first tick of the CPU and after it
+	 * comes back online, until the next tick. The tick updates it every
+	 * jiffy, anything older than that is read from the clocksource.
+	 */
+	if (unlikely(tick_nohz_tick_stopped() ||
+		     jiffies - READ_ONCE(kc->stamp) > 1)) {
+		mono = ktime_get_cached_refresh();
+	} else {
+		do {
+			start = u64_stats_fetch_begin_irq(&kc->syncp);
+			mono = kc->mono;
+		} while (u64_stats_fetch_retry_irq(&kc->syncp, start));
+	}
+	preempt_enable_notrace();
+
+	return mono;
+}
+EXPORT_SYMBOL_GPL(ktime_get_cached);
+
 u32 ktime_get_resolution_ns(void)
 {
 	struct timekeeper *tk = &tk_core.timekeeper;
@@ -1534,6 +1622,10 @@ void __init timekeeping_init(void)
 	struct timekeeper *tk = &tk_core.timekeeper;
 	struct clocksource *clock;
 	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu(ktime_cache, cpu).syncp);
 
 	read_persistent_wall_and_boot_offset(&wall_time, &boot_offset);
 	if (timespec64_valid_settod(&wall_time) &&
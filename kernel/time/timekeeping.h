@@ -24,6 +24,7 @@ static inline void sched_clock_resume(void) { }
 
 extern void do_timer(unsigned long ticks);
 extern void update_wall_time(void);
+extern void ktime_cache_update(ktime_t now);
 
 extern raw_spinlock_t jiffies_lock;
 extern seqcount_t jiffies_seq;
@@ -180,16 +180,28 @@ EXPORT_SYMBOL(jiffies_64);
 /*
  * The resulting wheel size. If NOHZ is configured we allocate two
  * wheels so we have a separate storage for the deferrable timers.
+ * With the timer migration hierarchy a third one keeps the timers which
+ * are not pinned (BASE_GLOBAL) apart from the pinned ones (BASE_LOCAL),
+ * so that an idle CPU can leave the former to a busy CPU.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
-# define BASE_STD	0
-# define BASE_DEF	1
+# ifdef CONFIG_TIMER_MIGRATION
+#  define NR_BASES	3
+#  define BASE_LOCAL	0
+#  define BASE_GLOBAL	1
+#  define BASE_DEF	2
+# else
+#  define NR_BASES	2
+#  define BASE_LOCAL	0
+#  define BASE_GLOBAL	0
+#  define BASE_DEF	1
+# endif
 #else
 # define NR_BASES	1
-# define BASE_STD	0
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -205,6 +217,7 @@ struct timer_base {
 	unsigned int		cpu;
 	bool			is_idle;
 	bool			must_forward_clk;
+	bool			expiry_active;
 	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
 	struct hlist_head	vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
@@ -833,30 +846,25 @@ static int detach_if_pending(struct timer_list *timer, struct timer_base *base,
 	return 1;
 }
 
-static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
+static inline int get_timer_base_index(u32 tflags)
 {
-	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_STD], cpu);
-
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
 	 * to use the deferrable base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
-		base = per_cpu_ptr(&timer_bases[BASE_DEF], cpu);
-	return base;
+		return BASE_DEF;
+	return tflags & TIMER_PINNED ? BASE_LOCAL : BASE_GLOBAL;
 }
 
-static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
+static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	return per_cpu_ptr(&timer_bases[get_timer_base_index(tflags)], cpu);
+}
 
-	/*
-	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
-	 * to use the deferrable base.
-	 */
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
-		base = this_cpu_ptr(&timer_bases[BASE_DEF]);
-	return base;
+static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
+{
+	return this_cpu_ptr(&timer_bases[get_timer_base_index(tflags)]);
 }
 
 static inline struct timer_base *get_timer_base(u32 tflags)
@@ -864,10 +872,15 @@ static inline struct timer_base *get_timer_base(u32 tflags)
 	return get_timer_cpu_base(tflags, tflags & TIMER_CPUMASK);
 }
 
+/*
+ * With the timer migration hierarchy timers are always queued locally: if
+ * this CPU goes idle, a busy one expires its global timers.
+ */
 static inline struct timer_base *
 get_target_base(struct timer_base *base, unsigned tflags)
 {
-#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON) && \
+	!defined(CONFIG_TIMER_MIGRATION)
 	if (static_branch_likely(&timers_migration_enabled) &&
 	    !(tflags & TIMER_PINNED))
 		return get_timer_cpu_base(tflags, get_nohz_timer_target());
@@ -1152,6 +1165,10 @@ void add_timer_on(struct timer_list *timer, int cpu)
 
 	BUG_ON(timer_pending(timer) || !timer->function);
 
+	/* The timer must stay on @cpu, even when that goes idle */
+	if (!(timer->flags & TIMER_PINNED))
+		timer->flags |= TIMER_PINNED;
+
 	new_base = get_timer_cpu_base(timer->flags, cpu);
 
 	/*
@@ -1597,6 +1614,48 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
 	return DIV_ROUND_UP_ULL(nextevt, TICK_NSEC) * TICK_NSEC;
 }
 
+/*
+ * Find the next expiring timer of @base and forward the base clock to
+ * @basej if possible. Caller must hold base->lock.
+ */
+static unsigned long next_timer_forward_base(struct timer_base *base,
+					     unsigned long basej)
+{
+	unsigned long nextevt = __next_timer_interrupt(base);
+
+	base->next_expiry = nextevt;
+	/*
+	 * We have a fresh next event. Check whether we can forward the
+	 * base. We can only do that when @basej is past base->clk
+	 * otherwise we might rewind base->clk.
+	 */
+	if (time_after(basej, base->clk)) {
+		if (time_after(nextevt, basej))
+			base->clk = basej;
+		else if (time_after(nextevt, base->clk))
+			base->clk = nextevt;
+	}
+	return nextevt;
+}
+
+#ifdef CONFIG_TIMER_MIGRATION
+/* Extend a jiffies value close to now to 64 bit */
+static u64 timer_jiffies64(unsigned long j)
+{
+	u64 now = get_jiffies_64();
+
+	return now + (long)(j - (unsigned long)now);
+}
+
+/* The first expiry of @base as jiffies64, TMIGR_NONE if it is empty */
+static u64 timer_base_next64(struct timer_base *base, unsigned long nextevt)
+{
+	if (nextevt == base->clk + NEXT_TIMER_MAX_DELTA)
+		return TMIGR_NONE;
+	return timer_jiffies64(nextevt);
+}
+#endif
+
 /**
  * get_next_timer_interrupt - return the time (clock mono) of the next timer
  * @basej:	base time jiffies
@@ -1604,13 +1663,23 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
  *
  * Returns the tick aligned clock monotonic time of the next pending
  * timer or KTIME_MAX if no timer is pending.
+ *
+ * With the timer migration hierarchy an idle CPU hands its global timers
+ * over to it and only takes them into account here when it has to handle
+ * them itself.
  */
 u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
 	u64 expires = KTIME_MAX;
 	unsigned long nextevt;
 	bool is_max_delta;
+#ifdef CONFIG_TIMER_MIGRATION
+	struct timer_base *base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+	unsigned long next_global;
+	u64 basej64, wakeup;
+	bool migrate;
+#endif
 
 	/*
 	 * Pretend that there is no timer pending if the cpu is offline.
@@ -1620,20 +1689,24 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		return expires;
 
 	raw_spin_lock(&base->lock);
-	nextevt = __next_timer_interrupt(base);
+	nextevt = next_timer_forward_base(base, basej);
 	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
-	base->next_expiry = nextevt;
+#ifdef CONFIG_TIMER_MIGRATION
+	raw_spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
+	next_global = next_timer_forward_base(base_global, basej);
 	/*
-	 * We have a fresh next event. Check whether we can forward the
-	 * base. We can only do that when @basej is past base->clk
-	 * otherwise we might rewind base->clk.
+	 * Only the idle task hands the global timers over. A busy nohz_full
+	 * CPU, and any CPU whose global timers are already due, keeps them.
 	 */
-	if (time_after(basej, base->clk)) {
-		if (time_after(nextevt, basej))
-			base->clk = basej;
-		else if (time_after(nextevt, base->clk))
-			base->clk = nextevt;
+	migrate = static_branch_likely(&timers_migration_enabled) &&
+		  is_idle_task(current);
+	if (next_global != base_global->clk + NEXT_TIMER_MAX_DELTA &&
+	    (!migrate || time_before_eq(next_global, basej)) &&
+	    (is_max_delta || time_before(next_global, nextevt))) {
+		nextevt = next_global;
+		is_max_delta = false;
 	}
+#endif
 
 	if (time_before_eq(nextevt, basej)) {
 		expires = basem;
@@ -1645,7 +1718,8 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		 * If we expect to sleep more than a tick, mark the base idle.
 		 * Also the tick is stopped so any added timer must forward
 		 * the base clk itself to keep granularity small. This idle
-		 * logic is only maintained for the BASE_STD base, deferrable
+		 * logic is only maintained for the BASE_LOCAL and BASE_GLOBAL
+		 * bases, deferrable
 		 * timers may still see large granularity skew (by design).
 		 */
 		if ((expires - basem) > TICK_NSEC) {
@@ -1653,6 +1727,28 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 			base->is_idle = true;
 		}
 	}
+#ifdef CONFIG_TIMER_MIGRATION
+	base_global->is_idle = base->is_idle;
+	if (base->is_idle)
+		base_global->must_forward_clk = true;
+	/*
+	 * Hand the global timers over while still holding the global base
+	 * lock, which serializes against a remote CPU expiring them.
+	 */
+	if (migrate && base->is_idle) {
+		wakeup = tmigr_cpu_deactivate(timer_base_next64(base_global,
+								next_global));
+		if (wakeup != TMIGR_NONE) {
+			basej64 = timer_jiffies64(basej);
+			if (wakeup <= basej64)
+				expires = basem;
+			else
+				expires = min_t(u64, expires, basem +
+						(wakeup - basej64) * TICK_NSEC);
+		}
+	}
+	raw_spin_unlock(&base_global->lock);
+#endif
 	raw_spin_unlock(&base->lock);
 
 	return cmp_next_hrtimer_event(basem, expires);
@@ -1665,7 +1761,7 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
  */
 void timer_clear_idle(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
 
 	/*
 	 * We do this unlocked. The worst outcome is a remote enqueue sending
@@ -1674,6 +1770,11 @@ void timer_clear_idle(void)
 	 * the lock in the exit from idle path.
 	 */
 	base->is_idle = false;
+#ifdef CONFIG_TIMER_MIGRATION
+	this_cpu_ptr(&timer_bases[BASE_GLOBAL])->is_idle = false;
+	/* Take the global timers back from the hierarchy */
+	tmigr_cpu_activate();
+#endif
 }
 
 static int collect_expired_timers(struct timer_base *base,
@@ -1738,22 +1839,40 @@ void update_process_times(int user_tick)
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  */
-static inline void __run_timers(struct timer_base *base)
+/*
+ * Returns false if another CPU is running the timers of @base, which then
+ * also takes care of what is due now.
+ */
+static inline bool __run_timers(struct timer_base *base)
 {
 	struct hlist_head heads[LVL_DEPTH];
 	int levels;
 
 	if (!time_after_eq(jiffies, base->clk))
-		return;
+		return true;
 
 	timer_base_lock_expiry(base);
 	raw_spin_lock_irq(&base->lock);
 
+	/*
+	 * With timer migration the global base of an idle CPU is also
+	 * expired remotely. expire_timers() drops the lock around each
+	 * callback, so a second runner would overwrite running_timer and
+	 * break del_timer_sync(). The active runner keeps going until the
+	 * base has caught up with jiffies, so just leave it to that one.
+	 */
+	if (base->expiry_active) {
+		raw_spin_unlock_irq(&base->lock);
+		timer_base_unlock_expiry(base);
+		return false;
+	}
+	base->expiry_active = true;
+
 	/*
 	 * timer_base::must_forward_clk must be cleared before running
 	 * timers so that any timer functions that call mod_timer() will
 	 * not try to forward the base. Idle tracking / clock forwarding
-	 * logic is only used with BASE_STD timers.
+	 * logic is only used with BASE_LOCAL and BASE_GLOBAL timers.
 	 *
 	 * The must_forward_clk flag is cleared unconditionally also for
 	 * the deferrable base. The deferrable base is not affected by idle
@@ -1773,20 +1892,62 @@ static inline void __run_timers(struct timer_base *base)
 		while (levels--)
 			expire_timers(base, heads + levels);
 	}
+	base->expiry_active = false;
 	raw_spin_unlock_irq(&base->lock);
 	timer_base_unlock_expiry(base);
+	return true;
+}
+
+#ifdef CONFIG_TIMER_MIGRATION
+/**
+ * timer_expire_remote - expire the global timers of an idle CPU
+ * @cpu:	the idle CPU whose global timers are due
+ *
+ * Called by the timer migration hierarchy on a busy CPU, which then also
+ * gets the next global expiry of @cpu handed back.
+ */
+void timer_expire_remote(unsigned int cpu)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	unsigned long nextevt;
+
+	if (!__run_timers(base))
+		return;
+
+	raw_spin_lock_irq(&base->lock);
+	/*
+	 * Leave the base alone while another runner is in the callbacks: it
+	 * relies on must_forward_clk staying clear, and the next expiry is
+	 * only known once it is done.
+	 */
+	if (base->expiry_active) {
+		raw_spin_unlock_irq(&base->lock);
+		return;
+	}
+	/* __run_timers() cleared it, but @cpu may well still be idle. */
+	base->must_forward_clk = base->is_idle;
+	nextevt = __next_timer_interrupt(base);
+	base->next_expiry = nextevt;
+	tmigr_cpu_update_remote(cpu, timer_base_next64(base, nextevt));
+	raw_spin_unlock_irq(&base->lock);
 }
+#endif
 
 /*
  * This function runs timers and the timer-tq in bottom half context.
  */
 static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
 
 	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON))
+	if (IS_ENABLED(CONFIG_NO_HZ_COMMON)) {
+		if (IS_ENABLED(CONFIG_TIMER_MIGRATION)) {
+			__run_timers(this_cpu_ptr(&timer_bases[BASE_GLOBAL]));
+			tmigr_handle_remote();
+		}
 		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+	}
 }
 
 /*
@@ -1794,18 +1955,22 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
  */
 void run_local_timers(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	int i;
 
 	hrtimer_run_queues();
-	/* Raise the softirq only if required. */
-	if (time_before(jiffies, base->clk)) {
-		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON))
-			return;
-		/* CPU is awake, so check the deferrable base. */
-		base++;
-		if (time_before(jiffies, base->clk))
-			return;
+	/*
+	 * Raise the softirq only if required. The CPU is awake, so check
+	 * the deferrable base too, and whether any idle CPU's global timers
+	 * have to be expired on their behalf.
+	 */
+	for (i = 0; i < NR_BASES; i++, base++) {
+		if (time_after_eq(jiffies, base->clk))
+			goto raise;
 	}
+	if (!tmigr_requires_handle_remote())
+		return;
+raise:
 	raise_softirq(TIMER_SOFTIRQ);
 }
 
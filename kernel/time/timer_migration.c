@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Hierarchical migration of the global timers of idle CPUs
+ *
+ * Timers which are not pinned are queued in the per CPU BASE_GLOBAL timer
+ * wheel. When a CPU goes idle it does not keep waking up for them, but
+ * hands its first global expiry over to a hierarchy of groups and a CPU
+ * which is still busy expires them on its behalf, batched with those of
+ * the other idle CPUs nearby.
+ *
+ * The CPUs are grouped into leaf groups of up to TMIGR_CHILDREN_PER_GROUP
+ * CPUs of the same NUMA node. The groups are grouped again, per node as
+ * long as a node has more than one group and then across the nodes, until
+ * a single top level group is left.
+ *
+ * In every group the active child with the lowest index is the migrator.
+ * A group without active children is idle; it queues its first expiry as
+ * its event in the parent group, where the migrator of the parent takes
+ * care of it. On each tick a busy CPU walks up the hierarchy as long as it
+ * is the migrator and, when the first expiry of the idle children of a
+ * group has passed, runs the expired global timers of those CPUs.
+ *
+ * When the last CPU goes idle the whole hierarchy is idle. That CPU then
+ * programs its own wakeup for the first global expiry of all CPUs and
+ * handles all expired timers when it wakes up, before it goes back to
+ * idle. The same applies to an idle CPU which has to reevaluate its
+ * timers while the whole hierarchy is idle.
+ *
+ * The group locks are only taken bottom up, hand over hand. Updates of the
+ * first expiry of a CPU are serialized by its BASE_GLOBAL timer base lock,
+ * which nests outside of the group locks; the migrators only read the
+ * group state locklessly and go through the same updates.
+ */
+#include <linux/cpuhotplug.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tick.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+
+#include "tick-internal.h"
+#include "timer_migration.h"
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+static struct tmigr_group *tmigr_root __read_mostly;
+
+static void tmigr_update_next_expiry(struct tmigr_group *group)
+{
+	u64 next = TMIGR_NONE;
+	int i;
+
+	for (i = 0; i < group->num_children; i++)
+		next = min(next, group->child_expiry[i]);
+	WRITE_ONCE(group->next_expiry, next);
+}
+
+/*
+ * Propagate a change of child @idx of @group up the hierarchy. @change is
+ * positive when the child became active, negative when it went idle with
+ * its first expiry @evt and zero when only @evt of an idle child changed.
+ *
+ * Called with interrupts disabled.
+ */
+static void tmigr_update_up(struct tmigr_group *group, unsigned int idx,
+			    int change, u64 evt)
+{
+	struct tmigr_group *parent;
+	bool was_idle;
+	u64 old;
+	u8 bit;
+
+	raw_spin_lock_nested(&group->lock, group->level);
+	for (;;) {
+		bit = BIT(idx);
+		/* An active child handles its timers itself. */
+		if (!change && (group->active & bit))
+			break;
+
+		was_idle = !group->active;
+		old = group->next_expiry;
+		if (change > 0) {
+			WRITE_ONCE(group->active, group->active | bit);
+			WRITE_ONCE(group->child_expiry[idx], TMIGR_NONE);
+		} else {
+			if (change < 0)
+				WRITE_ONCE(group->active, group->active & ~bit);
+			WRITE_ONCE(group->child_expiry[idx], evt);
+		}
+		tmigr_update_next_expiry(group);
+
+		parent = group->parent;
+		if (!parent)
+			break;
+		if (was_idle != !group->active) {
+			change = group->active ? 1 : -1;
+		} else {
+			/* Only an idle group has an event in its parent. */
+			if (group->active || group->next_expiry == old)
+				break;
+			change = 0;
+		}
+		evt = group->next_expiry;
+		idx = group->index;
+
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		raw_spin_unlock(&group->lock);
+		group = parent;
+	}
+	raw_spin_unlock(&group->lock);
+}
+
+/* The first global expiry of all CPUs, if they are all idle. */
+static u64 tmigr_root_wakeup(void)
+{
+	if (READ_ONCE(tmigr_root->active))
+		return TMIGR_NONE;
+	return READ_ONCE(tmigr_root->next_expiry);
+}
+
+/**
+ * tmigr_cpu_deactivate() - Hand the global timers of an idle CPU over
+ * @nextexp:	First expiry of the CPU's global timers (jiffies64)
+ *
+ * Called from the idle path with the CPU's BASE_GLOBAL timer base locked,
+ * and again whenever the CPU reevaluates its timers while idle.
+ *
+ * Return: the jiffies64 value the CPU has to wake up at to handle global
+ * timers itself, or TMIGR_NONE if a busy CPU takes care of them.
+ */
+u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	int change = 0;
+	u64 wakeup;
+
+	if (!tmc->available)
+		return nextexp;
+
+	if (!tmc->idle) {
+		tmc->idle = true;
+		change = -1;
+	}
+	tmigr_update_up(tmc->tmgroup, tmc->index, change, nextexp);
+
+	wakeup = tmigr_root_wakeup();
+	WRITE_ONCE(tmc->wakeup, wakeup);
+	return wakeup;
+}
+
+/**
+ * tmigr_cpu_activate() - Take the global timers of a CPU back
+ *
+ * Called when the CPU leaves idle, with interrupts disabled.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	if (!tmc->available || !tmc->idle)
+		return;
+
+	tmc->idle = false;
+	WRITE_ONCE(tmc->wakeup, TMIGR_NONE);
+	tmigr_update_up(tmc->tmgroup, tmc->index, 1, TMIGR_NONE);
+}
+
+/**
+ * tmigr_cpu_update_remote() - Update the first global expiry of an idle CPU
+ * @cpu:	The idle CPU whose timers were just expired remotely
+ * @nextexp:	Its new first global expiry (jiffies64)
+ *
+ * Called with the BASE_GLOBAL timer base of @cpu locked. Nothing is done
+ * if @cpu became active in the meantime.
+ */
+void tmigr_cpu_update_remote(unsigned int cpu, u64 nextexp)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+	lockdep_assert_irqs_disabled();
+	tmigr_update_up(tmc->tmgroup, tmc->index, 0, nextexp);
+}
+
+/* Expire the timers of the idle children of @group which are due. */
+static void tmigr_handle_group(struct tmigr_group *group, u64 now)
+{
+	int i;
+
+	for (i = 0; i < group->num_children; i++) {
+		if (READ_ONCE(group->child_expiry[i]) > now)
+			continue;
+		if (group->leaf)
+			timer_expire_remote(group->cpus[i]);
+		else
+			tmigr_handle_group(group->groups[i], now);
+	}
+}
+
+static bool tmigr_is_migrator(u8 active, u8 childmask)
+{
+	return (active & childmask) && !(active & (childmask - 1));
+}
+
+/*
+ * Walk up the hierarchy as long as this CPU is the migrator and either
+ * check for or handle the groups whose idle children have timers due.
+ */
+static bool tmigr_walk_remote(struct tmigr_cpu *tmc, u64 now, bool handle)
+{
+	struct tmigr_group *group;
+	u8 childmask = tmc->childmask;
+	bool due = false;
+
+	for (group = tmc->tmgroup; group; group = group->parent) {
+		if (!tmigr_is_migrator(READ_ONCE(group->active), childmask))
+			break;
+		if (now >= READ_ONCE(group->next_expiry)) {
+			if (!handle)
+				return true;
+			tmigr_handle_group(group, now);
+			due = true;
+		}
+		childmask = group->childmask;
+	}
+	return due;
+}
+
+/**
+ * tmigr_requires_handle_remote() - Check for global timers of idle CPUs
+ *
+ * Called from the tick. Return: true if this CPU has to expire global
+ * timers of idle CPUs, i.e. raise the timer softirq.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 now;
+
+	if (!tmc->available)
+		return false;
+
+	now = get_jiffies_64();
+	if (tmc->idle)
+		return now >= READ_ONCE(tmc->wakeup);
+	return tmigr_walk_remote(tmc, now, false);
+}
+
+/**
+ * tmigr_handle_remote() - Expire the due global timers of idle CPUs
+ *
+ * Called from the timer softirq.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 now;
+
+	if (!tmc->available)
+		return;
+
+	now = get_jiffies_64();
+	if (tmc->idle) {
+		/* Woken up as the last active CPU: handle everything due. */
+		if (now < READ_ONCE(tmc->wakeup))
+			return;
+		WRITE_ONCE(tmc->wakeup, TMIGR_NONE);
+		tmigr_handle_group(tmigr_root, now);
+		return;
+	}
+	tmigr_walk_remote(tmc, now, true);
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	/*
+	 * A busy nohz_full CPU may run without the tick for long, so it
+	 * can't act as a migrator and keeps its global timers.
+	 */
+	if (tick_nohz_full_cpu(cpu))
+		return 0;
+
+	local_irq_disable();
+	tmc->idle = false;
+	tmc->wakeup = TMIGR_NONE;
+	WRITE_ONCE(tmc->available, true);
+	tmigr_update_up(tmc->tmgroup, tmc->index, 1, TMIGR_NONE);
+	local_irq_enable();
+	return 0;
+}
+
+/* Leaving idle to run this made the CPU active in the hierarchy. */
+static long tmigr_trigger_active(void *unused)
+{
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned int target;
+	bool stranded;
+
+	if (!tmc->available)
+		return 0;
+
+	/* The remaining timers are migrated by timers_dead_cpu(). */
+	local_irq_disable();
+	tmigr_update_up(tmc->tmgroup, tmc->index, tmc->idle ? 0 : -1,
+			TMIGR_NONE);
+	WRITE_ONCE(tmc->available, false);
+	tmc->idle = false;
+	/*
+	 * The idle CPUs did not program a wakeup for their global timers as
+	 * long as this CPU was active. If it was the last active one, wake
+	 * up another CPU, which then either stays active as the migrator or
+	 * goes idle as the last active CPU and programs the wakeup.
+	 */
+	stranded = tmigr_root_wakeup() != TMIGR_NONE;
+	local_irq_enable();
+
+	if (!stranded)
+		return 0;
+
+	for_each_online_cpu(target) {
+		if (target != cpu &&
+		    READ_ONCE(per_cpu_ptr(&tmigr_cpu, target)->available)) {
+			work_on_cpu(target, tmigr_trigger_active, NULL);
+			break;
+		}
+	}
+	return 0;
+}
+
+static struct tmigr_group *tmigr_group_alloc(unsigned int level, int node,
+					     bool leaf)
+{
+	struct tmigr_group *group;
+	int i;
+
+	group = kzalloc_node(sizeof(*group), GFP_KERNEL, node);
+	if (!group)
+		return NULL;
+
+	raw_spin_lock_init(&group->lock);
+	group->level = level;
+	group->numa_node = node;
+	group->leaf = leaf;
+	group->next_expiry = TMIGR_NONE;
+	for (i = 0; i < TMIGR_CHILDREN_PER_GROUP; i++)
+		group->child_expiry[i] = TMIGR_NONE;
+	return group;
+}
+
+static void __init tmigr_group_free(struct tmigr_group *group)
+{
+	int i;
+
+	if (!group->leaf) {
+		for (i = 0; i < group->num_children; i++)
+			tmigr_group_free(group->groups[i]);
+	}
+	kfree(group);
+}
+
+static int __init tmigr_build_hierarchy(void)
+{
+	struct tmigr_group **cur, **next, **open, *group, *child;
+	unsigned int n = 0, nr_next = 0, level = 0, i;
+	int cpu, node, slot, ret = -ENOMEM;
+	bool by_node;
+
+	cur = kcalloc(nr_cpu_ids, sizeof(*cur), GFP_KERNEL);
+	next = kcalloc(nr_cpu_ids, sizeof(*next), GFP_KERNEL);
+	open = kcalloc(nr_node_ids, sizeof(*open), GFP_KERNEL);
+	if (!cur || !next || !open)
+		goto out;
+
+	/* Leaf groups of up to TMIGR_CHILDREN_PER_GROUP CPUs of a node */
+	for_each_possible_cpu(cpu) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		node = max(cpu_to_node(cpu), 0);
+		group = open[node];
+		if (!group || group->num_children == TMIGR_CHILDREN_PER_GROUP) {
+			group = tmigr_group_alloc(0, node, true);
+			if (!group)
+				goto err;
+			open[node] = cur[n++] = group;
+		}
+		tmc->tmgroup = group;
+		tmc->index = group->num_children;
+		tmc->childmask = BIT(tmc->index);
+		tmc->wakeup = TMIGR_NONE;
+		group->cpus[group->num_children++] = cpu;
+	}
+
+	/*
+	 * Group the groups of each node for as long as a node has more than
+	 * one, then group across the nodes.
+	 */
+	while (n > 1) {
+		if (++level >= MAX_LOCKDEP_SUBCLASSES) {
+			ret = -E2BIG;
+			goto err;
+		}
+
+		memset(open, 0, nr_node_ids * sizeof(*open));
+		by_node = false;
+		for (i = 0; i < n && !by_node; i++) {
+			node = cur[i]->numa_node;
+			if (node == NUMA_NO_NODE)
+				break;
+			by_node = !!open[node];
+			open[node] = cur[i];
+		}
+
+		memset(open, 0, nr_node_ids * sizeof(*open));
+		nr_next = 0;
+		for (i = 0; i < n; i++) {
+			child = cur[i];
+			slot = by_node ? child->numa_node : 0;
+			group = open[slot];
+			if (!group ||
+			    group->num_children == TMIGR_CHILDREN_PER_GROUP) {
+				node = by_node ? child->numa_node : NUMA_NO_NODE;
+				group = tmigr_group_alloc(level, node, false);
+				if (!group)
+					goto err;
+				open[slot] = next[nr_next++] = group;
+			}
+			child->parent = group;
+			child->index = group->num_children;
+			child->childmask = BIT(child->index);
+			group->groups[group->num_children++] = child;
+		}
+		swap(cur, next);
+		n = nr_next;
+		nr_next = 0;
+	}
+
+	tmigr_root = cur[0];
+	ret = 0;
+	goto out;
+
+err:
+	/* The groups of the level being built only point to @cur ones */
+	for (i = 0; i < nr_next; i++)
+		kfree(next[i]);
+	for (i = 0; i < n; i++)
+		tmigr_group_free(cur[i]);
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(&tmigr_cpu, cpu)->tmgroup = NULL;
+out:
+	kfree(open);
+	kfree(next);
+	kfree(cur);
+	return ret;
+}
+
+static int __init tmigr_init(void)
+{
+	int ret;
+
+	ret = tmigr_build_hierarchy();
+	if (ret)
+		goto err;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "tmigr:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	if (ret < 0)
+		goto err;
+
+	pr_info("Timer migration: %u levels of groups of up to %d children\n",
+		tmigr_root->level + 1, TMIGR_CHILDREN_PER_GROUP);
+	return 0;
+
+err:
+	pr_err("Timer migration setup failed: %d\n", ret);
+	return ret;
+}
+early_initcall(tmigr_init);
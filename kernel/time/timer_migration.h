@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+/* Maximum number of children of a group, must fit into the u8 masks */
+#define TMIGR_CHILDREN_PER_GROUP	8
+
+/**
+ * struct tmigr_group - timer migration hierarchy group
+ * @lock:		Protects @active, @child_expiry and @next_expiry
+ * @parent:		Pointer to the parent group, NULL for the top level group
+ * @childmask:		Bit of this group in @parent->active
+ * @index:		Index of this group in @parent's children
+ * @active:		Mask of the children which are active
+ * @num_children:	Number of children of this group
+ * @leaf:		The children are CPUs rather than groups
+ * @level:		Hierarchy level of the group, 0 for the leaf groups
+ * @numa_node:		NUMA node of the children, NUMA_NO_NODE if mixed
+ * @next_expiry:	First expiry of the idle children, jiffies64
+ * @child_expiry:	First global timer expiry of each idle child; an
+ *			active child never has an event queued here
+ * @cpus:		CPU numbers of the children of a leaf group
+ * @groups:		Child groups of an inner group
+ *
+ * The idle children of a group are handled by the group's migrator, which
+ * is the active child with the lowest index. An idle group passes its
+ * @next_expiry up as its event in the parent group.
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	u8			childmask;
+	u8			index;
+	u8			active;
+	u8			num_children;
+	bool			leaf;
+	unsigned int		level;
+	int			numa_node;
+	u64			next_expiry;
+	u64			child_expiry[TMIGR_CHILDREN_PER_GROUP];
+	union {
+		unsigned int		cpus[TMIGR_CHILDREN_PER_GROUP];
+		struct tmigr_group	*groups[TMIGR_CHILDREN_PER_GROUP];
+	};
+};
+
+/**
+ * struct tmigr_cpu - timer migration per CPU state
+ * @tmgroup:		Leaf group this CPU belongs to
+ * @childmask:		Bit of this CPU in @tmgroup->active
+ * @index:		Index of this CPU in @tmgroup's children
+ * @available:		The CPU takes part in the hierarchy
+ * @idle:		The CPU is idle and has handed its global timers over
+ * @wakeup:		When the CPU went idle as the last active CPU, the
+ *			first global expiry of the whole hierarchy it has to
+ *			wake up for, jiffies64; TMIGR_NONE otherwise
+ *
+ * All fields but @wakeup are only written by the CPU itself.
+ */
+struct tmigr_cpu {
+	struct tmigr_group	*tmgroup;
+	u8			childmask;
+	u8			index;
+	bool			available;
+	bool			idle;
+	u64			wakeup;
+};
+
+#endif /* _KERNEL_TIME_MIGRATION_H */
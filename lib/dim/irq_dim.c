@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Interrupt moderation driven by the irq timings prediction, for devices
+ * which have no completion or traffic counters to feed net_dim or rdma_dim.
+ */
+
+#include <linux/dim.h>
+#include <linux/interrupt.h>
+
+/*
+ * IRQ DIM profiles, from no moderation for sparse interrupts up to the
+ * largest window for interrupt storms. Profile ix is the target while the
+ * predicted interval is at least irq_dim_interval[ix] nanoseconds, i.e.
+ * the rate thresholds are 8k, 32k, 128k and 512k interrupts per second.
+ */
+#define IRQ_DIM_PARAMS_NUM_PROFILES 5
+
+static const struct dim_cq_moder irq_profile[IRQ_DIM_PARAMS_NUM_PROFILES] = {
+	{1,   1},
+	{16,  8},
+	{32,  16},
+	{64,  32},
+	{128, 64},
+};
+
+static const u32 irq_dim_interval[IRQ_DIM_PARAMS_NUM_PROFILES] = {
+	125000, 31250, 7812, 1953, 0,
+};
+
+struct dim_cq_moder irq_dim_get_moderation(int ix)
+{
+	return irq_profile[ix];
+}
+EXPORT_SYMBOL_GPL(irq_dim_get_moderation);
+
+void irq_dim_init(struct dim *dim, work_func_t func)
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->state = DIM_START_MEASURE;
+	dim->tune_state = DIM_GOING_RIGHT;
+	dim->profile_ix = IRQ_DIM_START_PROFILE;
+	INIT_WORK(&dim->work, func);
+
+	irq_timings_enable();
+}
+EXPORT_SYMBOL_GPL(irq_dim_init);
+
+static int irq_dim_target(u64 interval)
+{
+	int ix;
+
+	for (ix = 0; ix < IRQ_DIM_PARAMS_NUM_PROFILES - 1; ix++) {
+		if (interval >= irq_dim_interval[ix])
+			break;
+	}
+
+	return ix;
+}
+
+/*
+ * Move one profile towards the target at a time, so a single odd
+ * prediction cannot switch the device between the extremes.
+ */
+static bool irq_dim_decision(struct dim *dim, u64 interval)
+{
+	int target = irq_dim_target(interval);
+
+	if (target > dim->profile_ix) {
+		if (dim->tune_state != DIM_GOING_RIGHT)
+			dim_turn(dim);
+		dim->profile_ix++;
+		dim->steps_right++;
+	} else if (target < dim->profile_ix) {
+		if (dim->tune_state != DIM_GOING_LEFT)
+			dim_turn(dim);
+		dim->profile_ix--;
+		dim->steps_left++;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+void irq_dim(struct dim *dim, unsigned int irq)
+{
+	struct dim_sample *curr_sample = &dim->measuring_sample;
+	u16 nevents;
+
+	curr_sample->event_ctr++;
+
+	switch (dim->state) {
+	case DIM_MEASURE_IN_PROGRESS:
+		nevents = BIT_GAP(BITS_PER_TYPE(u16), curr_sample->event_ctr,
+				  dim->start_sample.event_ctr);
+		if (nevents < DIM_NEVENTS)
+			break;
+		if (irq_dim_decision(dim, irq_timings_interval(irq))) {
+			dim->state = DIM_APPLY_NEW_PROFILE;
+			schedule_work(&dim->work);
+			break;
+		}
+		/* fall through */
+	case DIM_START_MEASURE:
+		dim->start_sample.event_ctr = curr_sample->event_ctr;
+		dim->state = DIM_MEASURE_IN_PROGRESS;
+		break;
+	case DIM_APPLY_NEW_PROFILE:
+		break;
+	}
+}
+EXPORT_SYMBOL_GPL(irq_dim);
@@ -255,6 +255,7 @@ p9_virtio_request(struct p9_client *client, struct p9_req_t *req)
 	unsigned long flags;
 	struct virtio_chan *chan = client->trans;
 	struct scatterlist *sgs[2];
+	bool need_notify;
 
 	p9_debug(P9_DEBUG_TRANS, "9p debug: virtio request\n");
 
@@ -294,9 +295,16 @@ p9_virtio_request(struct p9_client *client, struct p9_req_t *req)
 			return -EIO;
 		}
 	}
-	virtqueue_kick(chan->vq);
+	need_notify = virtqueue_kick_prepare(chan->vq);
 	spin_unlock_irqrestore(&chan->lock, flags);
 
+	/*
+	 * Notifying the host is usually a VM exit; do it after dropping
+	 * chan->lock so other submitters and req_done() aren't held up.
+	 */
+	if (need_notify)
+		virtqueue_notify(chan->vq);
+
 	p9_debug(P9_DEBUG_TRANS, "virtio request kicked\n");
 	return 0;
 }
@@ -397,6 +405,7 @@ p9_virtio_zc_request(struct p9_client *client, struct p9_req_t *req,
 	size_t offs;
 	int need_drop = 0;
 	int kicked = 0;
+	bool need_notify;
 
 	p9_debug(P9_DEBUG_TRANS, "virtio request\n");
 
@@ -493,8 +502,10 @@ p9_virtio_zc_request(struct p9_client *client, struct p9_req_t *req,
 			goto err_out;
 		}
 	}
-	virtqueue_kick(chan->vq);
+	need_notify = virtqueue_kick_prepare(chan->vq);
 	spin_unlock_irqrestore(&chan->lock, flags);
+	if (need_notify)
+		virtqueue_notify(chan->vq);
 	kicked = 1;
 	p9_debug(P9_DEBUG_TRANS, "virtio request kicked\n");
 	err = wait_event_killable(req->wq, req->status >= REQ_STATUS_RCVD);
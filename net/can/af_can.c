@@ -60,6 +60,7 @@
 #include <linux/can/skb.h>
 #include <linux/can/can-ml.h>
 #include <linux/ratelimit.h>
+#include <linux/hash.h>
 #include <net/net_namespace.h>
 #include <net/sock.h>
 
@@ -334,6 +335,39 @@ static unsigned int effhash(canid_t can_id)
 	return hash & ((1 << CAN_EFF_RCV_HASH_BITS) - 1);
 }
 
+/**
+ * filhash - hash function for masked CAN identifiers of RX_FIL entries
+ * @can_id: CAN identifier with the filter mask already applied
+ *
+ * Return:
+ *  Hash value from 0x00 - 0x3F ( enforced by CAN_FIL_RCV_HASH_BITS )
+ */
+static unsigned int filhash(canid_t can_id)
+{
+	return hash_32(can_id, CAN_FIL_RCV_HASH_BITS);
+}
+
+/**
+ * can_fil_group_find - find the RX_FIL hash group for a given filter mask
+ * @dev_rcv_lists: pointer to the device filter struct
+ * @mask: consistency checked CAN mask (see can_rcv_list_find())
+ *
+ * Description:
+ *  Must be called with the rcvlists_lock held.
+ */
+static struct can_fil_group *can_fil_group_find(struct can_dev_rcv_lists *dev_rcv_lists,
+						canid_t mask)
+{
+	struct can_fil_group *grp;
+
+	hlist_for_each_entry(grp, &dev_rcv_lists->rx_fil_groups, list) {
+		if (grp->mask == mask)
+			return grp;
+	}
+
+	return NULL;
+}
+
 /**
  * can_rcv_list_find - determine optimal filterlist inside device filter struct
  * @can_id: pointer to CAN identifier of a given can_filter
@@ -446,6 +480,7 @@ int can_rx_register(struct net *net, struct net_device *dev, canid_t can_id,
 	struct hlist_head *rcv_list;
 	struct can_dev_rcv_lists *dev_rcv_lists;
 	struct can_rcv_lists_stats *rcv_lists_stats = net->can.rcv_lists_stats;
+	struct can_fil_group *grp, *new_grp;
 	int err = 0;
 
 	/* insert new receiver  (dev,canid,mask) -> (func,data) */
@@ -460,6 +495,13 @@ int can_rx_register(struct net *net, struct net_device *dev, canid_t can_id,
 	if (!rcv)
 		return -ENOMEM;
 
+	/* we can't allocate under the spinlock, so provide a mask group */
+	new_grp = kzalloc(sizeof(*new_grp), GFP_KERNEL);
+	if (!new_grp) {
+		kmem_cache_free(rcv_cache, rcv);
+		return -ENOMEM;
+	}
+
 	spin_lock_bh(&net->can.rcvlists_lock);
 
 	dev_rcv_lists = can_dev_rcv_lists_find(net, dev);
@@ -476,11 +518,27 @@ int can_rx_register(struct net *net, struct net_device *dev, canid_t can_id,
 	hlist_add_head_rcu(&rcv->list, rcv_list);
 	dev_rcv_lists->entries++;
 
+	/* can_id/mask entries are looked up per mask group at receive time */
+	if (rcv_list == &dev_rcv_lists->rx[RX_FIL]) {
+		grp = can_fil_group_find(dev_rcv_lists, mask);
+		if (!grp) {
+			grp = new_grp;
+			new_grp = NULL;
+			grp->mask = mask;
+			hlist_add_head_rcu(&grp->list,
+					   &dev_rcv_lists->rx_fil_groups);
+		}
+		hlist_add_head_rcu(&rcv->fil_list, &grp->rx[filhash(can_id)]);
+		grp->entries++;
+	}
+
 	rcv_lists_stats->rcv_entries++;
 	rcv_lists_stats->rcv_entries_max = max(rcv_lists_stats->rcv_entries_max,
 					       rcv_lists_stats->rcv_entries);
 	spin_unlock_bh(&net->can.rcvlists_lock);
 
+	kfree(new_grp);
+
 	return err;
 }
 EXPORT_SYMBOL(can_rx_register);
@@ -515,6 +573,7 @@ void can_rx_unregister(struct net *net, struct net_device *dev, canid_t can_id,
 	struct hlist_head *rcv_list;
 	struct can_rcv_lists_stats *rcv_lists_stats = net->can.rcv_lists_stats;
 	struct can_dev_rcv_lists *dev_rcv_lists;
+	struct can_fil_group *grp = NULL;
 
 	if (dev && dev->type != ARPHRD_CAN)
 		return;
@@ -529,12 +588,25 @@ void can_rx_unregister(struct net *net, struct net_device *dev, canid_t can_id,
 
 	/* Search the receiver list for the item to delete.  This should
 	 * exist, since no receiver may be unregistered that hasn't
-	 * been registered before.
+	 * been registered before.  can_id/mask entries are found through
+	 * their (much shorter) mask group hash chain.
 	 */
-	hlist_for_each_entry_rcu(rcv, rcv_list, list) {
-		if (rcv->can_id == can_id && rcv->mask == mask &&
-		    rcv->func == func && rcv->data == data)
-			break;
+	if (rcv_list == &dev_rcv_lists->rx[RX_FIL]) {
+		grp = can_fil_group_find(dev_rcv_lists, mask);
+		if (grp) {
+			hlist_for_each_entry(rcv, &grp->rx[filhash(can_id)],
+					     fil_list) {
+				if (rcv->can_id == can_id &&
+				    rcv->func == func && rcv->data == data)
+					break;
+			}
+		}
+	} else {
+		hlist_for_each_entry_rcu(rcv, rcv_list, list) {
+			if (rcv->can_id == can_id && rcv->mask == mask &&
+			    rcv->func == func && rcv->data == data)
+				break;
+		}
 	}
 
 	/* Check for bugs in CAN protocol implementations using af_can.c:
@@ -549,6 +621,14 @@ void can_rx_unregister(struct net *net, struct net_device *dev, canid_t can_id,
 	hlist_del_rcu(&rcv->list);
 	dev_rcv_lists->entries--;
 
+	if (grp) {
+		hlist_del_rcu(&rcv->fil_list);
+		if (!--grp->entries) {
+			hlist_del_rcu(&grp->list);
+			kfree_rcu(grp, rcu);
+		}
+	}
+
 	if (rcv_lists_stats->rcv_entries > 0)
 		rcv_lists_stats->rcv_entries--;
 
@@ -573,6 +653,7 @@ static inline void deliver(struct sk_buff *skb, struct receiver *rcv)
 static int can_rcv_filter(struct can_dev_rcv_lists *dev_rcv_lists, struct sk_buff *skb)
 {
 	struct receiver *rcv;
+	struct can_fil_group *grp;
 	int matches = 0;
 	struct can_frame *cf = (struct can_frame *)skb->data;
 	canid_t can_id = cf->can_id;
@@ -597,11 +678,16 @@ static int can_rcv_filter(struct can_dev_rcv_lists *dev_rcv_lists, struct sk_buf
 		matches++;
 	}
 
-	/* check for can_id/mask entries */
-	hlist_for_each_entry_rcu(rcv, &dev_rcv_lists->rx[RX_FIL], list) {
-		if ((can_id & rcv->mask) == rcv->can_id) {
-			deliver(skb, rcv);
-			matches++;
+	/* check for can_id/mask entries: one hash lookup per distinct mask */
+	hlist_for_each_entry_rcu(grp, &dev_rcv_lists->rx_fil_groups, list) {
+		canid_t masked_id = can_id & grp->mask;
+
+		hlist_for_each_entry_rcu(rcv, &grp->rx[filhash(masked_id)],
+					 fil_list) {
+			if (rcv->can_id == masked_id) {
+				deliver(skb, rcv);
+				matches++;
+			}
 		}
 	}
 
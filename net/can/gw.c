@@ -96,8 +96,19 @@ struct cf_mod {
 		u8 xor;
 		u8 set;
 	} modtype;
-	void (*modfunc[MAX_MODFUNCTIONS])(struct canfd_frame *cf,
-					  struct cf_mod *mod);
+	/* AND/OR/XOR/SET modifications folded at configuration time into
+	 * one operation per frame element: elem = (elem & keep) ^ toggle
+	 */
+	struct {
+		struct {
+			u64 data[CANFD_MAX_DLEN / sizeof(u64)];
+			canid_t can_id;
+			u8 len;
+			u8 flags;
+		} keep, toggle;
+		u8 modtype; /* CGW_MOD_* elements to be modified */
+		u8 datawords; /* number of u64 data words to be modified */
+	} fold;
 
 	/* CAN frame checksum calculation after CAN frame modifications */
 	struct {
@@ -149,55 +160,78 @@ struct cgw_job {
 	u16 flags;
 };
 
-/* modification functions that are invoked in the hot path in can_can_gw_rcv */
-
-#define MODFUNC(func, op) static void func(struct canfd_frame *cf, \
-					   struct cf_mod *mod) { op ; }
-
-MODFUNC(mod_and_id, cf->can_id &= mod->modframe.and.can_id)
-MODFUNC(mod_and_len, cf->len &= mod->modframe.and.len)
-MODFUNC(mod_and_flags, cf->flags &= mod->modframe.and.flags)
-MODFUNC(mod_and_data, *(u64 *)cf->data &= *(u64 *)mod->modframe.and.data)
-MODFUNC(mod_or_id, cf->can_id |= mod->modframe.or.can_id)
-MODFUNC(mod_or_len, cf->len |= mod->modframe.or.len)
-MODFUNC(mod_or_flags, cf->flags |= mod->modframe.or.flags)
-MODFUNC(mod_or_data, *(u64 *)cf->data |= *(u64 *)mod->modframe.or.data)
-MODFUNC(mod_xor_id, cf->can_id ^= mod->modframe.xor.can_id)
-MODFUNC(mod_xor_len, cf->len ^= mod->modframe.xor.len)
-MODFUNC(mod_xor_flags, cf->flags ^= mod->modframe.xor.flags)
-MODFUNC(mod_xor_data, *(u64 *)cf->data ^= *(u64 *)mod->modframe.xor.data)
-MODFUNC(mod_set_id, cf->can_id = mod->modframe.set.can_id)
-MODFUNC(mod_set_len, cf->len = mod->modframe.set.len)
-MODFUNC(mod_set_flags, cf->flags = mod->modframe.set.flags)
-MODFUNC(mod_set_data, *(u64 *)cf->data = *(u64 *)mod->modframe.set.data)
-
-static void mod_and_fddata(struct canfd_frame *cf, struct cf_mod *mod)
+/* fold one AND/OR/XOR/SET modification into the keep/toggle pair */
+enum { CGW_FOLD_AND, CGW_FOLD_OR, CGW_FOLD_XOR, CGW_FOLD_SET };
+
+#define CGW_FOLD(op, keep, toggle, val)			\
+	do {						\
+		switch (op) {				\
+		case CGW_FOLD_AND:			\
+			keep &= (val);			\
+			toggle &= (val);		\
+			break;				\
+		case CGW_FOLD_OR:			\
+			keep &= ~(val);			\
+			toggle |= (val);		\
+			break;				\
+		case CGW_FOLD_XOR:			\
+			toggle ^= (val);		\
+			break;				\
+		case CGW_FOLD_SET:			\
+			keep = 0;			\
+			toggle = (val);			\
+			break;				\
+		}					\
+	} while (0)
+
+static void cgw_fold_mod(struct cf_mod *mod, int op, u8 modtype,
+			 struct canfd_frame *cf, int dlen)
 {
 	int i;
 
-	for (i = 0; i < CANFD_MAX_DLEN; i += 8)
-		*(u64 *)(cf->data + i) &= *(u64 *)(mod->modframe.and.data + i);
-}
+	if (modtype & CGW_MOD_ID)
+		CGW_FOLD(op, mod->fold.keep.can_id, mod->fold.toggle.can_id,
+			 cf->can_id);
 
-static void mod_or_fddata(struct canfd_frame *cf, struct cf_mod *mod)
-{
-	int i;
+	if (modtype & CGW_MOD_LEN)
+		CGW_FOLD(op, mod->fold.keep.len, mod->fold.toggle.len,
+			 cf->len);
 
-	for (i = 0; i < CANFD_MAX_DLEN; i += 8)
-		*(u64 *)(cf->data + i) |= *(u64 *)(mod->modframe.or.data + i);
+	if (modtype & CGW_MOD_FLAGS)
+		CGW_FOLD(op, mod->fold.keep.flags, mod->fold.toggle.flags,
+			 cf->flags);
+
+	if (modtype & CGW_MOD_DATA) {
+		mod->fold.datawords = dlen / sizeof(u64);
+		for (i = 0; i < mod->fold.datawords; i++)
+			CGW_FOLD(op, mod->fold.keep.data[i],
+				 mod->fold.toggle.data[i],
+				 *(u64 *)(cf->data + i * sizeof(u64)));
+	}
+
+	mod->fold.modtype |= modtype;
 }
 
-static void mod_xor_fddata(struct canfd_frame *cf, struct cf_mod *mod)
+/* modification function that is invoked in the hot path in can_can_gw_rcv */
+static void cgw_mod_frame(struct canfd_frame *cf, struct cf_mod *mod)
 {
 	int i;
 
-	for (i = 0; i < CANFD_MAX_DLEN; i += 8)
-		*(u64 *)(cf->data + i) ^= *(u64 *)(mod->modframe.xor.data + i);
-}
+	if (mod->fold.modtype & CGW_MOD_ID)
+		cf->can_id = (cf->can_id & mod->fold.keep.can_id) ^
+			     mod->fold.toggle.can_id;
 
-static void mod_set_fddata(struct canfd_frame *cf, struct cf_mod *mod)
-{
-	memcpy(cf->data, mod->modframe.set.data, CANFD_MAX_DLEN);
+	if (mod->fold.modtype & CGW_MOD_LEN)
+		cf->len = (cf->len & mod->fold.keep.len) ^ mod->fold.toggle.len;
+
+	if (mod->fold.modtype & CGW_MOD_FLAGS)
+		cf->flags = (cf->flags & mod->fold.keep.flags) ^
+			    mod->fold.toggle.flags;
+
+	for (i = 0; i < mod->fold.datawords; i++)
+		*(u64 *)(cf->data + i * sizeof(u64)) =
+			(*(u64 *)(cf->data + i * sizeof(u64)) &
+			 mod->fold.keep.data[i]) ^ mod->fold.toggle.data[i];
 }
 
 static void canframecpy(struct canfd_frame *dst, struct can_frame *src)
@@ -398,7 +432,6 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 	struct cgw_job *gwj = (struct cgw_job *)data;
 	struct canfd_frame *cf;
 	struct sk_buff *nskb;
-	int modidx = 0;
 
 	/* process strictly Classic CAN or CAN FD frames */
 	if (gwj->flags & CGW_FLAGS_CAN_FD) {
@@ -445,7 +478,7 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 	 * When there is at least one modification function activated,
 	 * we need to copy the skb as we want to modify skb->data.
 	 */
-	if (gwj->mod.modfunc[0])
+	if (gwj->mod.fold.modtype)
 		nskb = skb_copy(skb, GFP_ATOMIC);
 	else
 		nskb = skb_clone(skb, GFP_ATOMIC);
@@ -467,15 +500,13 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 	/* pointer to modifiable CAN frame */
 	cf = (struct canfd_frame *)nskb->data;
 
-	/* perform preprocessed modification functions if there are any */
-	while (modidx < MAX_MODFUNCTIONS && gwj->mod.modfunc[modidx])
-		(*gwj->mod.modfunc[modidx++])(cf, &gwj->mod);
-
-	/* Has the CAN frame been modified? */
-	if (modidx) {
+	/* perform preprocessed modifications if there are any */
+	if (gwj->mod.fold.modtype) {
 		/* get available space for the processed CAN frame type */
 		int max_len = nskb->len - offsetof(struct canfd_frame, data);
 
+		cgw_mod_frame(cf, &gwj->mod);
+
 		/* dlc may have changed, make sure it fits to the CAN frame */
 		if (cf->len > max_len) {
 			/* delete frame due to misconfiguration */
@@ -734,11 +765,11 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 {
 	struct nlattr *tb[CGW_MAX + 1];
 	struct rtcanmsg *r = nlmsg_data(nlh);
-	int modidx = 0;
 	int err = 0;
 
 	/* initialize modification & checksum data space */
 	memset(mod, 0, sizeof(*mod));
+	memset(&mod->fold.keep, 0xFF, sizeof(mod->fold.keep));
 
 	err = nlmsg_parse_deprecated(nlh, sizeof(struct rtcanmsg), tb,
 				     CGW_MAX, cgw_policy, NULL);
@@ -762,17 +793,8 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canfdframecpy(&mod->modframe.and, &mb.cf);
 			mod->modtype.and = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_and_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_and_len;
-
-			if (mb.modtype & CGW_MOD_FLAGS)
-				mod->modfunc[modidx++] = mod_and_flags;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_and_fddata;
+			cgw_fold_mod(mod, CGW_FOLD_AND, mb.modtype,
+				     &mod->modframe.and, CANFD_MAX_DLEN);
 		}
 
 		if (tb[CGW_FDMOD_OR]) {
@@ -781,17 +803,8 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canfdframecpy(&mod->modframe.or, &mb.cf);
 			mod->modtype.or = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_or_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_or_len;
-
-			if (mb.modtype & CGW_MOD_FLAGS)
-				mod->modfunc[modidx++] = mod_or_flags;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_or_fddata;
+			cgw_fold_mod(mod, CGW_FOLD_OR, mb.modtype,
+				     &mod->modframe.or, CANFD_MAX_DLEN);
 		}
 
 		if (tb[CGW_FDMOD_XOR]) {
@@ -800,17 +813,8 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canfdframecpy(&mod->modframe.xor, &mb.cf);
 			mod->modtype.xor = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_xor_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_xor_len;
-
-			if (mb.modtype & CGW_MOD_FLAGS)
-				mod->modfunc[modidx++] = mod_xor_flags;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_xor_fddata;
+			cgw_fold_mod(mod, CGW_FOLD_XOR, mb.modtype,
+				     &mod->modframe.xor, CANFD_MAX_DLEN);
 		}
 
 		if (tb[CGW_FDMOD_SET]) {
@@ -819,17 +823,8 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canfdframecpy(&mod->modframe.set, &mb.cf);
 			mod->modtype.set = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_set_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_set_len;
-
-			if (mb.modtype & CGW_MOD_FLAGS)
-				mod->modfunc[modidx++] = mod_set_flags;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_set_fddata;
+			cgw_fold_mod(mod, CGW_FOLD_SET, mb.modtype,
+				     &mod->modframe.set, CANFD_MAX_DLEN);
 		}
 	} else {
 		struct cgw_frame_mod mb;
@@ -840,14 +835,9 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canframecpy(&mod->modframe.and, &mb.cf);
 			mod->modtype.and = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_and_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_and_len;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_and_data;
+			cgw_fold_mod(mod, CGW_FOLD_AND, mb.modtype &
+				     (CGW_MOD_ID | CGW_MOD_LEN | CGW_MOD_DATA),
+				     &mod->modframe.and, CAN_MAX_DLEN);
 		}
 
 		if (tb[CGW_MOD_OR]) {
@@ -856,14 +846,9 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canframecpy(&mod->modframe.or, &mb.cf);
 			mod->modtype.or = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_or_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_or_len;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_or_data;
+			cgw_fold_mod(mod, CGW_FOLD_OR, mb.modtype &
+				     (CGW_MOD_ID | CGW_MOD_LEN | CGW_MOD_DATA),
+				     &mod->modframe.or, CAN_MAX_DLEN);
 		}
 
 		if (tb[CGW_MOD_XOR]) {
@@ -872,14 +857,9 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canframecpy(&mod->modframe.xor, &mb.cf);
 			mod->modtype.xor = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_xor_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_xor_len;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_xor_data;
+			cgw_fold_mod(mod, CGW_FOLD_XOR, mb.modtype &
+				     (CGW_MOD_ID | CGW_MOD_LEN | CGW_MOD_DATA),
+				     &mod->modframe.xor, CAN_MAX_DLEN);
 		}
 
 		if (tb[CGW_MOD_SET]) {
@@ -888,19 +868,14 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 			canframecpy(&mod->modframe.set, &mb.cf);
 			mod->modtype.set = mb.modtype;
 
-			if (mb.modtype & CGW_MOD_ID)
-				mod->modfunc[modidx++] = mod_set_id;
-
-			if (mb.modtype & CGW_MOD_LEN)
-				mod->modfunc[modidx++] = mod_set_len;
-
-			if (mb.modtype & CGW_MOD_DATA)
-				mod->modfunc[modidx++] = mod_set_data;
+			cgw_fold_mod(mod, CGW_FOLD_SET, mb.modtype &
+				     (CGW_MOD_ID | CGW_MOD_LEN | CGW_MOD_DATA),
+				     &mod->modframe.set, CAN_MAX_DLEN);
 		}
 	}
 
 	/* check for checksum operations after CAN frame modifications */
-	if (modidx) {
+	if (mod->fold.modtype) {
 		if (tb[CGW_CS_CRC8]) {
 			struct cgw_csum_crc8 *c = nla_data(tb[CGW_CS_CRC8]);
 
@@ -1398,6 +1398,8 @@ struct netlink_broadcast_data {
 	struct sk_buff *skb, *skb2;
 	int (*tx_filter)(struct sock *dsk, struct sk_buff *skb, void *data);
 	void *tx_data;
+	struct net *nsid_net;
+	int nsid;
 };
 
 static void do_one_broadcast(struct sock *sk,
@@ -1461,7 +1463,12 @@ static void do_one_broadcast(struct sock *sk,
 		p->skb2 = NULL;
 		goto out;
 	}
-	NETLINK_CB(p->skb2).nsid = peernet2id(sock_net(sk), p->net);
+	/* Listeners mostly live in the same netns, look the id up once */
+	if (p->nsid_net != sock_net(sk)) {
+		p->nsid_net = sock_net(sk);
+		p->nsid = peernet2id(p->nsid_net, p->net);
+	}
+	NETLINK_CB(p->skb2).nsid = p->nsid;
 	if (NETLINK_CB(p->skb2).nsid != NETNSA_NSID_NOT_ASSIGNED)
 		NETLINK_CB(p->skb2).nsid_is_set = true;
 	val = netlink_broadcast_deliver(sk, p->skb2);
@@ -1502,6 +1509,7 @@ int netlink_broadcast_filtered(struct sock *ssk, struct sk_buff *skb, u32 portid
 	info.skb2 = NULL;
 	info.tx_filter = filter;
 	info.tx_data = filter_data;
+	info.nsid_net = NULL;
 
 	/* While we sleep in clone, do not allow to change socket list */
 
@@ -445,7 +445,8 @@ bool ovs_meter_execute(struct datapath *dp, struct sk_buff *skb,
 {
 	struct dp_meter *meter;
 	struct dp_meter_band *band;
-	long long int now_ms = div_u64(ktime_get_ns(), 1000 * 1000);
+	long long int now_ms = div_u64(ktime_to_ns(ktime_get_cached()),
+				       1000 * 1000);
 	long long int long_delta_ms;
 	u32 delta_ms;
 	u32 cost;
@@ -462,6 +463,14 @@ bool ovs_meter_execute(struct datapath *dp, struct sk_buff *skb,
 
 	long_delta_ms = (now_ms - meter->used); /* ms */
 
+	/* The cached time of this CPU may lag behind the one which last
+	 * used the meter by up to a tick.
+	 */
+	if (long_delta_ms < 0) {
+		long_delta_ms = 0;
+		now_ms = meter->used;
+	}
+
 	/* Make sure delta_ms will not be too large, so that bucket will not
 	 * wrap around below.
 	 */
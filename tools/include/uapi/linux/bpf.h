@@ -369,6 +369,15 @@ enum {
 
 /* Enable memory-mapping BPF map */
 	BPF_F_MMAPABLE		= (1U << 10),
+
+/* Use the clock (second chance) flavour of the LRU, with per-CPU lists */
+	BPF_F_LRU_CLOCK		= (1U << 11),
+
+/* Keep a multibit index of the LPM trie for faster lookups */
+	BPF_F_LPM_MULTIBIT	= (1U << 12),
+
+/* Store the stacks of a stack trace map deduplicated, sharing frames */
+	BPF_F_STACK_DEDUP	= (1U << 13),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -1207,7 +1216,15 @@ union bpf_attr {
  * 			# sysctl kernel.perf_event_max_stack=<new value>
  * 	Return
  * 		The positive or null stack id on success, or a negative error
- * 		in case of failure.
+ * 		in case of failure. With a *map* created with
+ * 		**BPF_F_STACK_DEDUP**, this includes
+ *
+ * 		**-ENOMEM** if the frame pool of *map* has no room for the
+ * 		frames of the stack that it does not share with the stored
+ * 		stacks.
+ *
+ * 		**-EBUSY** if the helper runs in NMI context and interrupted
+ * 		its CPU while that accessed a **BPF_F_STACK_DEDUP** map.
  *
  * s64 bpf_csum_diff(__be32 *from, u32 from_size, __be32 *to, u32 to_size, __wsum seed)
  * 	Description
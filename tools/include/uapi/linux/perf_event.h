@@ -383,7 +383,8 @@ struct perf_event_attr {
 				bpf_event      :  1, /* include bpf events */
 				aux_output     :  1, /* generate AUX records instead of events */
 				cgroup         :  1, /* include cgroup events */
-				__reserved_1   : 31;
+				user_page_group :  1, /* group counters in user page */
+				__reserved_1   : 30;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -481,6 +482,12 @@ enum perf_event_ioc_flags {
 /*
  * Structure of the page that can be mapped via mmap
  */
+/*
+ * Maximum number of siblings of a group leader opened with
+ * attr.user_page_group, all of them have to fit its user page.
+ */
+#define PERF_USER_PAGE_GROUP_MAX	16
+
 struct perf_event_mmap_page {
 	__u32	version;		/* version number of this structure */
 	__u32	compat_version;		/* lowest version this is compat with */
@@ -519,6 +526,10 @@ struct perf_event_mmap_page {
 	 *
 	 * NOTE: for obvious reason this only works on self-monitoring
 	 *       processes.
+	 *
+	 * The user page of a group leader opened with attr.user_page_group
+	 * also carries the counters of its siblings, see @group_nr below, so
+	 * the whole group can be read in the same loop.
 	 */
 	__u32	lock;			/* seqlock for synchronization */
 	__u32	index;			/* hardware event identifier */
@@ -595,11 +606,43 @@ struct perf_event_mmap_page {
 	__u64	time_zero;
 	__u32	size;			/* Header size up to __reserved[] fields. */
 
+	/*
+	 * If the event is a group leader opened with attr.user_page_group,
+	 * @group[] holds the counters of its @group_nr siblings, in the
+	 * order they were added to the group. They are updated under @lock
+	 * together with the leader's own fields, and are read like the
+	 * leader's @index and @offset inside the seqlock loop above:
+	 *
+	 *     nr = pc->group_nr;
+	 *     for (i = 0; i < nr; i++) {
+	 *       index = pc->group[i].index;
+	 *       count[i + 1] = pc->group[i].offset;
+	 *       if (index)
+	 *         count[i + 1] += rdpmc(index - 1);
+	 *     }
+	 *
+	 * The members of a group are always scheduled together, so the
+	 * leader's @time_enabled and @time_running apply to all of them.
+	 *
+	 * A sibling's @index is only set when its counter may be read with
+	 * rdpmc. Mapping the leader allows that for its siblings as well,
+	 * which is why the loop does not test @cap_user_rdpmc, it only
+	 * covers the leader. Otherwise @index is 0 and @offset is the count
+	 * at the last update of the page. No sibling can be added to the
+	 * group while the leader is mmapped.
+	 */
+	__u32	group_nr;
+	struct {
+		__u32	index;		/* hardware event identifier */
+		__u32	__reserved;
+		__s64	offset;		/* add to hardware event value */
+	} group[PERF_USER_PAGE_GROUP_MAX];
+
 		/*
 		 * Hole for extension of the self monitor capabilities
 		 */
 
-	__u8	__reserved[118*8+4];	/* align to 1k. */
+	__u8	__reserved[86*8];	/* align to 1k. */
 
 	/*
 	 * Control data for the mmap() data buffer.
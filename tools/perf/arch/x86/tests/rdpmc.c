@@ -82,6 +82,37 @@ static u64 mmap_read_self(void *addr)
 	return count;
 }
 
+/*
+ * Read a user_page_group leader and its siblings in the same seqlock loop:
+ */
+static u32 mmap_read_group(void *addr, u64 *counts)
+{
+	struct perf_event_mmap_page *pc = addr;
+	u32 seq, idx, nr, i;
+
+	do {
+		seq = pc->lock;
+		barrier();
+
+		idx = pc->index;
+		counts[0] = pc->offset;
+		if (idx)
+			counts[0] += rdpmc(idx - 1);
+
+		nr = pc->group_nr;
+		for (i = 0; i < nr; i++) {
+			idx = pc->group[i].index;
+			counts[i + 1] = pc->group[i].offset;
+			if (idx)
+				counts[i + 1] += rdpmc(idx - 1);
+		}
+
+		barrier();
+	} while (pc->lock != seq);
+
+	return nr;
+}
+
 /*
  * If the RDPMC instruction faults then signal this back to the test parent task:
  */
@@ -157,6 +188,87 @@ static int __test__rdpmc(void)
 	return 0;
 }
 
+/*
+ * The sibling is only mapped through the leader, so this faults unless
+ * mapping the leader allowed rdpmc on the whole group:
+ */
+static int __test__rdpmc_group(void)
+{
+	volatile int tmp = 0;
+	u64 i, loops = 1000;
+	int n, nr;
+	int fd, sibling_fd;
+	void *addr;
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.config = PERF_COUNT_HW_INSTRUCTIONS,
+		.exclude_kernel = 1,
+		.user_page_group = 1,
+	};
+	u64 stamp[2], now[2], delta_sum[2] = { 0, 0 };
+	char sbuf[STRERR_BUFSIZE];
+	int ret = -1;
+
+	fd = sys_perf_event_open(&attr, 0, -1, -1,
+				 perf_event_open_cloexec_flag());
+	if (fd < 0) {
+		pr_err("Error: sys_perf_event_open() syscall returned "
+		       "with %d (%s)\n", fd,
+		       str_error_r(errno, sbuf, sizeof(sbuf)));
+		return -1;
+	}
+
+	attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+	attr.user_page_group = 0;
+	sibling_fd = sys_perf_event_open(&attr, 0, -1, fd,
+					 perf_event_open_cloexec_flag());
+	if (sibling_fd < 0) {
+		pr_err("Error: sys_perf_event_open() syscall returned "
+		       "with %d (%s)\n", sibling_fd,
+		       str_error_r(errno, sbuf, sizeof(sbuf)));
+		goto out_close;
+	}
+
+	addr = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == (void *)(-1)) {
+		pr_err("Error: mmap() syscall returned with (%s)\n",
+		       str_error_r(errno, sbuf, sizeof(sbuf)));
+		goto out_close_sibling;
+	}
+
+	for (n = 0; n < 6; n++) {
+		nr = mmap_read_group(addr, stamp);
+
+		for (i = 0; i < loops; i++)
+			tmp++;
+
+		if (nr != 1 || mmap_read_group(addr, now) != 1) {
+			pr_err("Error: expected 1 sibling in the user page\n");
+			goto out_unmap;
+		}
+		loops *= 10;
+
+		pr_debug("%14d: %14Lu %14Lu\n", n,
+			 (long long)(now[0] - stamp[0]),
+			 (long long)(now[1] - stamp[1]));
+
+		delta_sum[0] += now[0] - stamp[0];
+		delta_sum[1] += now[1] - stamp[1];
+	}
+
+	if (delta_sum[0] && delta_sum[1])
+		ret = 0;
+out_unmap:
+	munmap(addr, page_size);
+	pr_debug("   ");
+out_close_sibling:
+	close(sibling_fd);
+out_close:
+	close(fd);
+
+	return ret;
+}
+
 int test__rdpmc(struct test *test __maybe_unused, int subtest __maybe_unused)
 {
 	int status = 0;
@@ -170,6 +282,8 @@ int test__rdpmc(struct test *test __maybe_unused, int subtest __maybe_unused)
 
 	if (!pid) {
 		ret = __test__rdpmc();
+		if (!ret)
+			ret = __test__rdpmc_group();
 
 		exit(ret);
 	}
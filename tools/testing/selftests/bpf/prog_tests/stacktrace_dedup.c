@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <test_progs.h>
+#include "test_stacktrace_dedup.skel.h"
+
+#define STACK_DEPTH	4
+
+/* Take a kernel stack in the sys_enter tracepoint of getpgid() */
+static long get_stackid(struct test_stacktrace_dedup *skel, bool one,
+			__u64 flags)
+{
+	skel->bss->use_one = one;
+	skel->bss->flags = flags;
+	skel->bss->did_run = 0;
+
+	syscall(__NR_getpgid, 0);
+
+	return skel->bss->did_run ? skel->bss->stackid : -ESRCH;
+}
+
+/* Skipping frames gives the callers of a stack, so all these stacks share
+ * their frames. Each of them has to come back intact until it is deleted.
+ */
+static void test_shared_frames(struct test_stacktrace_dedup *skel)
+{
+	__u64 ips[STACK_DEPTH][STACK_DEPTH], val[STACK_DEPTH];
+	int map_fd, err, i, j, n, duration = 0;
+	__u32 ids[STACK_DEPTH], key, next_key;
+	long id;
+
+	map_fd = bpf_map__fd(skel->maps.stackmap);
+
+	for (i = 0; i < STACK_DEPTH; i++) {
+		id = get_stackid(skel, false, i);
+		if (CHECK(id < 0, "get_stackid", "skip %d: err %ld\n", i, id))
+			return;
+		ids[i] = id;
+
+		/* The same stack again has the same id */
+		id = get_stackid(skel, false, i);
+		if (CHECK(id != ids[i], "get_stackid_again",
+			  "skip %d: id %ld, expected %u\n", i, id, ids[i]))
+			return;
+
+		err = bpf_map_lookup_elem(map_fd, &ids[i], ips[i]);
+		if (CHECK(err, "lookup", "skip %d: err %d errno %d\n", i,
+			  err, errno))
+			return;
+	}
+
+	if (CHECK(!ips[0][STACK_DEPTH - 1], "stack_depth",
+		  "stack shorter than %d frames\n", STACK_DEPTH))
+		return;
+
+	for (i = 1; i < STACK_DEPTH; i++) {
+		for (j = 0; j < STACK_DEPTH; j++) {
+			__u64 ip = i + j < STACK_DEPTH ? ips[0][i + j] : 0;
+
+			if (CHECK(ips[i][j] != ip, "shared_frames",
+				  "skip %d frame %d: ip %llx, expected %llx\n",
+				  i, j, ips[i][j], ip))
+				return;
+		}
+	}
+
+	/* Every stack is found exactly once */
+	n = 0;
+	err = bpf_map_get_next_key(map_fd, NULL, &key);
+	while (!err) {
+		for (i = 0; i < STACK_DEPTH && ids[i] != key; i++)
+			;
+		if (CHECK(i == STACK_DEPTH, "get_next_key",
+			  "unexpected key %u\n", key))
+			return;
+		n++;
+		err = bpf_map_get_next_key(map_fd, &key, &next_key);
+		key = next_key;
+	}
+	if (CHECK(n != STACK_DEPTH, "get_next_key", "%d keys, expected %d\n",
+		  n, STACK_DEPTH))
+		return;
+
+	/* Deleting the innermost stack leaves its callers alone */
+	err = bpf_map_delete_elem(map_fd, &ids[0]);
+	if (CHECK(err, "delete", "err %d errno %d\n", err, errno))
+		return;
+
+	err = bpf_map_delete_elem(map_fd, &ids[0]);
+	if (CHECK(!err || errno != ENOENT, "delete_again",
+		  "err %d errno %d\n", err, errno))
+		return;
+
+	err = bpf_map_lookup_elem(map_fd, &ids[0], val);
+	if (CHECK(!err || errno != ENOENT, "lookup_deleted",
+		  "err %d errno %d\n", err, errno))
+		return;
+
+	for (i = 1; i < STACK_DEPTH; i++) {
+		err = bpf_map_lookup_elem(map_fd, &ids[i], val);
+		if (CHECK(err || memcmp(val, ips[i], sizeof(val)),
+			  "lookup_caller", "skip %d: err %d errno %d\n", i,
+			  err, errno))
+			return;
+
+		err = bpf_map_delete_elem(map_fd, &ids[i]);
+		if (CHECK(err, "delete", "skip %d: err %d errno %d\n", i,
+			  err, errno))
+			return;
+	}
+
+	err = bpf_map_get_next_key(map_fd, NULL, &key);
+	CHECK(!err || errno != ENOENT, "get_next_key_empty",
+	      "err %d errno %d\n", err, errno);
+}
+
+/* A map with a single stack id and a pool of STACK_DEPTH frames. Replacing
+ * a stack only fits in the pool when the frames the new stack shares with
+ * the old one are not taken twice.
+ */
+static void test_reuse_stackid(struct test_stacktrace_dedup *skel)
+{
+	__u64 ips[STACK_DEPTH], val[STACK_DEPTH];
+	int map_fd, err, duration = 0;
+	__u32 key = 0, next_key;
+	long id;
+
+	map_fd = bpf_map__fd(skel->maps.stackmap_one);
+
+	/* One frame */
+	id = get_stackid(skel, true, STACK_DEPTH - 1);
+	if (CHECK(id != 0, "get_stackid", "id %ld\n", id))
+		return;
+
+	id = get_stackid(skel, true, STACK_DEPTH - 2);
+	if (CHECK(id != -EEXIST, "get_stackid_collision", "id %ld\n", id))
+		return;
+
+	/* Two frames, one of them new */
+	id = get_stackid(skel, true, (STACK_DEPTH - 2) | BPF_F_REUSE_STACKID);
+	if (CHECK(id != 0, "get_stackid_reuse", "id %ld\n", id))
+		return;
+
+	err = bpf_map_lookup_elem(map_fd, &key, ips);
+	if (CHECK(err, "lookup", "err %d errno %d\n", err, errno))
+		return;
+
+	/* All frames, two of them new, which fills the pool */
+	id = get_stackid(skel, true, BPF_F_REUSE_STACKID);
+	if (CHECK(id != 0, "get_stackid_reuse_shared", "id %ld\n", id))
+		return;
+
+	err = bpf_map_lookup_elem(map_fd, &key, val);
+	if (CHECK(err, "lookup", "err %d errno %d\n", err, errno))
+		return;
+	if (CHECK(memcmp(val + 2, ips, 2 * sizeof(__u64)),
+		  "shared_frames", "callers differ\n"))
+		return;
+	memcpy(ips, val, sizeof(ips));
+
+	/* A user space stack shares no frame with it */
+	id = get_stackid(skel, true, BPF_F_USER_STACK | BPF_F_REUSE_STACKID);
+	if (CHECK(id != -ENOMEM, "get_stackid_nomem", "id %ld\n", id))
+		return;
+
+	err = bpf_map_lookup_elem(map_fd, &key, val);
+	if (CHECK(err || memcmp(val, ips, sizeof(val)), "lookup_after_nomem",
+		  "err %d errno %d\n", err, errno))
+		return;
+
+	err = bpf_map_delete_elem(map_fd, &key);
+	if (CHECK(err, "delete", "err %d errno %d\n", err, errno))
+		return;
+
+	err = bpf_map_get_next_key(map_fd, NULL, &next_key);
+	if (CHECK(!err || errno != ENOENT, "get_next_key_empty",
+		  "err %d errno %d\n", err, errno))
+		return;
+
+	/* The frames went back to the pool */
+	id = get_stackid(skel, true, BPF_F_USER_STACK);
+	if (CHECK(id != 0, "get_stackid_after_delete", "id %ld\n", id))
+		return;
+
+	err = bpf_map_get_next_key(map_fd, NULL, &next_key);
+	if (CHECK(err || next_key != 0, "get_next_key",
+		  "err %d errno %d key %u\n", err, errno, next_key))
+		return;
+
+	err = bpf_map_get_next_key(map_fd, &next_key, &next_key);
+	CHECK(!err || errno != ENOENT, "get_next_key_last",
+	      "err %d errno %d\n", err, errno);
+}
+
+void test_stacktrace_dedup(void)
+{
+	struct test_stacktrace_dedup *skel;
+	int err, duration = 0;
+
+	skel = test_stacktrace_dedup__open_and_load();
+	if (CHECK(!skel, "skel_open_and_load", "skeleton open/load failed\n"))
+		return;
+
+	skel->bss->pid = getpid();
+	skel->bss->syscall_nr = __NR_getpgid;
+
+	err = test_stacktrace_dedup__attach(skel);
+	if (CHECK(err, "skel_attach", "skeleton attach failed: %d\n", err))
+		goto cleanup;
+
+	if (test__start_subtest("shared_frames"))
+		test_shared_frames(skel);
+	if (test__start_subtest("reuse_stackid"))
+		test_reuse_stackid(skel);
+
+cleanup:
+	test_stacktrace_dedup__destroy(skel);
+}
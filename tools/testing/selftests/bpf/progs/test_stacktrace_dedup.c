@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+
+/* Only the innermost frames are kept, so that the frame pools are small */
+#define STACK_DEPTH	4
+
+typedef __u64 stack_trace_t[STACK_DEPTH];
+
+struct {
+	__uint(type, BPF_MAP_TYPE_STACK_TRACE);
+	__uint(max_entries, 16384);
+	__uint(map_flags, BPF_F_STACK_DEDUP);
+	__uint(key_size, sizeof(__u32));
+	__uint(value_size, sizeof(stack_trace_t));
+} stackmap SEC(".maps");
+
+/* A single stack id, with a pool of STACK_DEPTH frames */
+struct {
+	__uint(type, BPF_MAP_TYPE_STACK_TRACE);
+	__uint(max_entries, 1);
+	__uint(map_flags, BPF_F_STACK_DEDUP);
+	__uint(key_size, sizeof(__u32));
+	__uint(value_size, sizeof(stack_trace_t));
+} stackmap_one SEC(".maps");
+
+int pid = 0;
+long syscall_nr = 0;
+__u64 flags = 0;
+int use_one = 0;
+long stackid = 0;
+int did_run = 0;
+
+SEC("raw_tracepoint/sys_enter")
+int get_stackid(struct bpf_raw_tracepoint_args *ctx)
+{
+	if (bpf_get_current_pid_tgid() >> 32 != pid ||
+	    ctx->args[1] != syscall_nr)
+		return 0;
+
+	if (use_one)
+		stackid = bpf_get_stackid(ctx, &stackmap_one, flags);
+	else
+		stackid = bpf_get_stackid(ctx, &stackmap, flags);
+	did_run = 1;
+
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
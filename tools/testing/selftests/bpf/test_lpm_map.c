@@ -12,6 +12,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <linux/bpf.h>
 #include <pthread.h>
@@ -206,12 +207,13 @@ static void test_lpm_order(void)
 	tlpm_clear(l2);
 }
 
-static void test_lpm_map(int keysize)
+static void test_lpm_map(int keysize, int map_flags)
 {
 	size_t i, j, n_matches, n_matches_after_delete, n_nodes, n_lookups;
 	struct tlpm_node *t, *list = NULL;
 	struct bpf_lpm_trie_key *key;
 	uint8_t *data, *value;
+	size_t n_bits;
 	int r, map;
 
 	/* Compare behavior of tlpm vs. bpf-lpm. Create a randomized set of
@@ -237,7 +239,7 @@ static void test_lpm_map(int keysize)
 			     sizeof(*key) + keysize,
 			     keysize + 1,
 			     4096,
-			     BPF_F_NO_PREALLOC);
+			     map_flags);
 	assert(map >= 0);
 
 	for (i = 0; i < n_nodes; ++i) {
@@ -311,6 +313,26 @@ static void test_lpm_map(int keysize)
 		}
 	}
 
+	/* Lookups only match prefixes which are not longer than the
+	 * prefixlen of the key, so run them again with random lengths.
+	 */
+	for (i = 0; i < n_lookups; ++i) {
+		for (j = 0; j < keysize; ++j)
+			data[j] = rand() & 0xff;
+		n_bits = rand() % (8 * keysize + 1);
+
+		t = tlpm_match(list, data, n_bits);
+
+		key->prefixlen = n_bits;
+		memcpy(key->data, data, keysize);
+		r = bpf_map_lookup_elem(map, key, value);
+		assert(!r || errno == ENOENT);
+		assert(!t == !!r);
+
+		if (t)
+			assert(t->n_bits == value[keysize]);
+	}
+
 	close(map);
 	tlpm_clear(list);
 
@@ -327,7 +349,7 @@ static void test_lpm_map(int keysize)
 
 /* Test the implementation with some 'real world' examples */
 
-static void test_lpm_ipaddr(void)
+static void test_lpm_ipaddr(int map_flags)
 {
 	struct bpf_lpm_trie_key *key_ipv4;
 	struct bpf_lpm_trie_key *key_ipv6;
@@ -344,12 +366,12 @@ static void test_lpm_ipaddr(void)
 
 	map_fd_ipv4 = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE,
 				     key_size_ipv4, sizeof(value),
-				     100, BPF_F_NO_PREALLOC);
+				     100, map_flags);
 	assert(map_fd_ipv4 >= 0);
 
 	map_fd_ipv6 = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE,
 				     key_size_ipv6, sizeof(value),
-				     100, BPF_F_NO_PREALLOC);
+				     100, map_flags);
 	assert(map_fd_ipv6 >= 0);
 
 	/* Fill data some IPv4 and IPv6 address ranges */
@@ -421,7 +443,7 @@ static void test_lpm_ipaddr(void)
 	close(map_fd_ipv6);
 }
 
-static void test_lpm_delete(void)
+static void test_lpm_delete(int map_flags)
 {
 	struct bpf_lpm_trie_key *key;
 	size_t key_size;
@@ -433,7 +455,7 @@ static void test_lpm_delete(void)
 
 	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE,
 				key_size, sizeof(value),
-				100, BPF_F_NO_PREALLOC);
+				100, map_flags);
 	assert(map_fd >= 0);
 
 	/* Add nodes:
@@ -533,7 +555,99 @@ static void test_lpm_delete(void)
 	close(map_fd);
 }
 
-static void test_lpm_get_next_key(void)
+/* With the multibit index, a delete which cannot allocate the shrunk index
+ * node leaves a NULL slot behind. Make the allocations of the delete fail
+ * one after the other through the fail-nth fault injection, and check that
+ * lookups skip the slot and that the prefix can be added again.
+ */
+static void test_lpm_delete_nomem(int map_flags)
+{
+	struct bpf_lpm_trie_key *key;
+	char buf[16];
+	size_t key_size;
+	int map_fd, fd, n, r;
+	__u64 value;
+
+	if (!(map_flags & BPF_F_LPM_MULTIBIT))
+		return;
+
+	fd = open("/proc/thread-self/fail-nth", O_RDWR);
+	if (fd < 0) {
+		printf("%s: Skip (no fault injection)\n", __func__);
+		return;
+	}
+
+	key_size = sizeof(*key) + sizeof(__u32);
+	key = alloca(key_size);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE,
+				key_size, sizeof(value),
+				100, map_flags);
+	assert(map_fd >= 0);
+
+	/* Add nodes:
+	 * 192.168.0.0/16   (1)
+	 * 192.168.128.0/24 (2)
+	 */
+	value = 1;
+	key->prefixlen = 16;
+	inet_pton(AF_INET, "192.168.0.0", key->data);
+	assert(bpf_map_update_elem(map_fd, key, &value, 0) == 0);
+
+	value = 2;
+	key->prefixlen = 24;
+	inet_pton(AF_INET, "192.168.128.0", key->data);
+	assert(bpf_map_update_elem(map_fd, key, &value, 0) == 0);
+
+	/* remove (2), failing the n-th allocation until the delete passes */
+	for (n = 1; ; n++) {
+		snprintf(buf, sizeof(buf), "%d", n);
+		assert(pwrite(fd, buf, strlen(buf), 0) > 0);
+
+		key->prefixlen = 24;
+		inet_pton(AF_INET, "192.168.128.0", key->data);
+		r = bpf_map_delete_elem(map_fd, key);
+
+		assert(pwrite(fd, "0", 1, 0) == 1);
+		if (!r)
+			break;
+		assert(errno == ENOMEM);
+
+		key->prefixlen = 32;
+		inet_pton(AF_INET, "192.168.128.1", key->data);
+		assert(bpf_map_lookup_elem(map_fd, key, &value) == 0);
+		assert(value == 2);
+	}
+
+	key->prefixlen = 32;
+	inet_pton(AF_INET, "192.168.128.1", key->data);
+	assert(bpf_map_lookup_elem(map_fd, key, &value) == 0);
+	assert(value == 1);
+
+	key->prefixlen = 24;
+	inet_pton(AF_INET, "192.168.128.0", key->data);
+	assert(bpf_map_delete_elem(map_fd, key) == -1 &&
+		errno == ENOENT);
+
+	/* add (2) again */
+	value = 2;
+	assert(bpf_map_update_elem(map_fd, key, &value, 0) == 0);
+
+	key->prefixlen = 32;
+	inet_pton(AF_INET, "192.168.128.1", key->data);
+	assert(bpf_map_lookup_elem(map_fd, key, &value) == 0);
+	assert(value == 2);
+
+	key->prefixlen = 32;
+	inet_pton(AF_INET, "192.168.1.1", key->data);
+	assert(bpf_map_lookup_elem(map_fd, key, &value) == 0);
+	assert(value == 1);
+
+	close(map_fd);
+	close(fd);
+}
+
+static void test_lpm_get_next_key(int map_flags)
 {
 	struct bpf_lpm_trie_key *key_p, *next_key_p;
 	size_t key_size;
@@ -545,7 +659,7 @@ static void test_lpm_get_next_key(void)
 	next_key_p = alloca(key_size);
 
 	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE, key_size, sizeof(value),
-				100, BPF_F_NO_PREALLOC);
+				100, map_flags);
 	assert(map_fd >= 0);
 
 	/* empty tree. get_next_key should return ENOENT */
@@ -751,7 +865,7 @@ static void setup_lpm_mt_test_info(struct lpm_mt_test_info *info, int map_fd)
 	inet_pton(AF_INET, "192.168.1.0", &info->key[3].data);
 }
 
-static void test_lpm_multi_thread(void)
+static void test_lpm_multi_thread(int map_flags)
 {
 	struct lpm_mt_test_info info[4];
 	size_t key_size, value_size;
@@ -763,7 +877,7 @@ static void test_lpm_multi_thread(void)
 	value_size = sizeof(__u32);
 	key_size = sizeof(struct bpf_lpm_trie_key) + value_size;
 	map_fd = bpf_create_map(BPF_MAP_TYPE_LPM_TRIE, key_size, value_size,
-				100, BPF_F_NO_PREALLOC);
+				100, map_flags);
 
 	/* create 4 threads to test update, delete, lookup and get_next_key */
 	setup_lpm_mt_test_info(&info[0], map_fd);
@@ -782,7 +896,9 @@ static void test_lpm_multi_thread(void)
 
 int main(void)
 {
-	int i;
+	int map_flags[] = {BPF_F_NO_PREALLOC,
+			   BPF_F_NO_PREALLOC | BPF_F_LPM_MULTIBIT};
+	int i, f;
 
 	/* we want predictable, pseudo random tests */
 	srand(0xf00ba1);
@@ -790,14 +906,18 @@ int main(void)
 	test_lpm_basic();
 	test_lpm_order();
 
-	/* Test with 8, 16, 24, 32, ... 128 bit prefix length */
-	for (i = 1; i <= 16; ++i)
-		test_lpm_map(i);
-
-	test_lpm_ipaddr();
-	test_lpm_delete();
-	test_lpm_get_next_key();
-	test_lpm_multi_thread();
+	/* Run the map tests on the binary trie and on the multibit index */
+	for (f = 0; f < sizeof(map_flags) / sizeof(*map_flags); f++) {
+		/* Test with 8, 16, 24, 32, ... 128 bit prefix length */
+		for (i = 1; i <= 16; ++i)
+			test_lpm_map(i, map_flags[f]);
+
+		test_lpm_ipaddr(map_flags[f]);
+		test_lpm_delete(map_flags[f]);
+		test_lpm_delete_nomem(map_flags[f]);
+		test_lpm_get_next_key(map_flags[f]);
+		test_lpm_multi_thread(map_flags[f]);
+	}
 
 	printf("test_lpm: OK\n");
 	return 0;
@@ -23,6 +23,7 @@
 
 #define LOCAL_FREE_TARGET	(128)
 #define PERCPU_FREE_TARGET	(4)
+#define CLOCK_NR_SCANS		(32)
 
 static int nr_cpus;
 
@@ -253,7 +254,7 @@ static void test_lru_sanity1(int map_type, int map_flags, unsigned int tgt_free)
 	unsigned int map_size;
 	int next_cpu = 0;
 
-	if (map_flags & BPF_F_NO_COMMON_LRU)
+	if (map_flags & (BPF_F_NO_COMMON_LRU | BPF_F_LRU_CLOCK))
 		/* This test is only applicable to common LRU list */
 		return;
 
@@ -330,7 +331,7 @@ static void test_lru_sanity2(int map_type, int map_flags, unsigned int tgt_free)
 	unsigned int map_size;
 	int next_cpu = 0;
 
-	if (map_flags & BPF_F_NO_COMMON_LRU)
+	if (map_flags & (BPF_F_NO_COMMON_LRU | BPF_F_LRU_CLOCK))
 		/* This test is only applicable to common LRU list */
 		return;
 
@@ -437,7 +438,7 @@ static void test_lru_sanity3(int map_type, int map_flags, unsigned int tgt_free)
 	unsigned int map_size;
 	int next_cpu = 0;
 
-	if (map_flags & BPF_F_NO_COMMON_LRU)
+	if (map_flags & (BPF_F_NO_COMMON_LRU | BPF_F_LRU_CLOCK))
 		/* This test is only applicable to common LRU list */
 		return;
 
@@ -867,11 +868,183 @@ static void test_lru_sanity8(int map_type, int map_flags)
 	printf("Pass\n");
 }
 
+/* Test the clock LRU eviction order
+ * Size of the LRU map is 2*n, n below CLOCK_NR_SCANS
+ * Insert 1 to 2*n (+2*n keys)
+ * Lookup 1 to n
+ * Insert 1+2*n to 3*n (+n keys)
+ *   => Key 1 to n get a second chance, 1+n to 2*n are removed by LRU
+ */
+static void test_lru_sanity9(int map_type, int map_flags)
+{
+	unsigned long long key, end_key, value[nr_cpus];
+	int lru_map_fd, expected_map_fd;
+	unsigned int n = CLOCK_NR_SCANS / 2;
+	int next_cpu = 0;
+
+	if (!(map_flags & BPF_F_LRU_CLOCK))
+		return;
+
+	printf("%s (map_type:%d map_flags:0x%X): ", __func__, map_type,
+	       map_flags);
+
+	assert(sched_next_online(0, &next_cpu) != -1);
+
+	lru_map_fd = create_map(map_type, map_flags, 2 * n);
+	assert(lru_map_fd != -1);
+
+	expected_map_fd = create_map(BPF_MAP_TYPE_HASH, 0, 2 * n);
+	assert(expected_map_fd != -1);
+
+	value[0] = 1234;
+
+	/* Insert 1 to 2*n, the whole map is usable from one CPU */
+	for (key = 1; key <= 2 * n; key++)
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+
+	/* Lookup 1 to n */
+	for (key = 1; key <= n; key++) {
+		assert(!bpf_map_lookup_elem_with_ref_bit(lru_map_fd, key, value));
+		assert(!bpf_map_update_elem(expected_map_fd, &key, value,
+					    BPF_NOEXIST));
+	}
+
+	/* Insert 1+2*n to 3*n
+	 * => 1+n to 2*n are removed by LRU
+	 */
+	key = 2 * n + 1;
+	end_key = key + n;
+	for (; key < end_key; key++) {
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+		assert(!bpf_map_update_elem(expected_map_fd, &key, value,
+					    BPF_NOEXIST));
+	}
+
+	assert(map_equal(lru_map_fd, expected_map_fd));
+
+	close(expected_map_fd);
+	close(lru_map_fd);
+
+	printf("Pass\n");
+}
+
+static void do_test_lru_sanity10(unsigned long long new_key, int map_fd)
+{
+	unsigned long long key, value[nr_cpus];
+
+	/* This CPU has neither free nodes nor nodes in use */
+	value[0] = 1234;
+	assert(!bpf_map_update_elem(map_fd, &new_key, value, BPF_NOEXIST));
+
+	/* Key 1 was referenced, the oldest unreferenced key 2 is gone */
+	key = 1;
+	assert(!bpf_map_lookup_elem(map_fd, &key, value));
+	key = 2;
+	assert(bpf_map_lookup_elem(map_fd, &key, value) == -1 &&
+	       errno == ENOENT);
+}
+
+/* Test clock LRU eviction from another CPU
+ * Size of the LRU map is n
+ * Insert 1 to n on one CPU (+n keys)
+ * Lookup 1
+ * Insert 1+n on another CPU
+ *   => The other CPU evicts from the first CPU's ring, and key 2 is
+ *      removed by LRU
+ */
+static void test_lru_sanity10(int map_type, int map_flags)
+{
+	unsigned long long key, value[nr_cpus];
+	int lru_map_fd, expected_map_fd;
+	unsigned int n = CLOCK_NR_SCANS;
+	int next_cpu = 0;
+	int status;
+	pid_t pid;
+
+	if (!(map_flags & BPF_F_LRU_CLOCK))
+		return;
+
+	printf("%s (map_type:%d map_flags:0x%X): ", __func__, map_type,
+	       map_flags);
+
+	assert(sched_next_online(0, &next_cpu) != -1);
+
+	lru_map_fd = create_map(map_type, map_flags, n);
+	assert(lru_map_fd != -1);
+
+	expected_map_fd = create_map(BPF_MAP_TYPE_HASH, 0, n);
+	assert(expected_map_fd != -1);
+
+	value[0] = 1234;
+
+	/* Insert 1 to n, taking the free nodes of all CPUs */
+	for (key = 1; key <= n; key++) {
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+		if (key != 2)
+			assert(!bpf_map_update_elem(expected_map_fd, &key,
+						    value, BPF_NOEXIST));
+	}
+
+	/* Lookup 1 */
+	assert(!bpf_map_lookup_elem_with_ref_bit(lru_map_fd, 1, value));
+
+	if (sched_next_online(0, &next_cpu) == -1) {
+		printf("Skip (needs a second CPU)\n");
+		goto out;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		do_test_lru_sanity10(key, lru_map_fd);
+		exit(0);
+	} else if (pid == -1) {
+		printf("couldn't spawn process to test key:%llu\n", key);
+		exit(1);
+	}
+
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(status == 0);
+
+	assert(!bpf_map_update_elem(expected_map_fd, &key, value,
+				    BPF_NOEXIST));
+	assert(map_equal(lru_map_fd, expected_map_fd));
+
+	printf("Pass\n");
+out:
+	close(expected_map_fd);
+	close(lru_map_fd);
+}
+
+/* BPF_F_LRU_CLOCK is only valid for the common LRU of an LRU map */
+static void test_lru_clock_flags(void)
+{
+	int map_fd;
+
+	printf("%s: ", __func__);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_LRU_HASH,
+				sizeof(unsigned long long),
+				sizeof(unsigned long long), 2 * nr_cpus,
+				BPF_F_LRU_CLOCK | BPF_F_NO_COMMON_LRU);
+	assert(map_fd == -1 && errno == EINVAL);
+
+	map_fd = bpf_create_map(BPF_MAP_TYPE_HASH,
+				sizeof(unsigned long long),
+				sizeof(unsigned long long), 2,
+				BPF_F_LRU_CLOCK);
+	assert(map_fd == -1 && errno == EINVAL);
+
+	printf("Pass\n");
+}
+
 int main(int argc, char **argv)
 {
 	int map_types[] = {BPF_MAP_TYPE_LRU_HASH,
 			     BPF_MAP_TYPE_LRU_PERCPU_HASH};
-	int map_flags[] = {0, BPF_F_NO_COMMON_LRU};
+	int map_flags[] = {0, BPF_F_NO_COMMON_LRU, BPF_F_LRU_CLOCK};
 	int t, f;
 
 	setbuf(stdout, NULL);
@@ -894,10 +1067,14 @@ int main(int argc, char **argv)
 			test_lru_sanity6(map_types[t], map_flags[f], tgt_free);
 			test_lru_sanity7(map_types[t], map_flags[f]);
 			test_lru_sanity8(map_types[t], map_flags[f]);
+			test_lru_sanity9(map_types[t], map_flags[f]);
+			test_lru_sanity10(map_types[t], map_flags[f]);
 
 			printf("\n");
 		}
 	}
 
+	test_lru_clock_flags();
+
 	return 0;
 }